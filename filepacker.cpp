@@ -1,7 +1,10 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <windows.h>
+#include <winioctl.h>
+#include <emmintrin.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <cstring>
 #include <assert.h>
 
@@ -114,28 +117,84 @@ enum FileType
 
 struct FileEntry
 {
-    char name[MAX_PATH];
-    char path[MAX_PATH];
+    char path[MAX_PATH]; //NOTE(alg): the name is the last <nameLen> bytes of the path, see entryName
     u32 nameLen;
     u32 pathLen;
     u64 size;
     FileType type;
 };
 
+inline
+char const * entryName(FileEntry* entry)
+{
+    return entry->path + entry->pathLen - entry->nameLen;
+}
+
+//NOTE(alg): raise at build time (e.g. -DMAX_FILE_ENTRY_COUNT=1048576) for very large trees
+#ifndef MAX_FILE_ENTRY_COUNT
+#define MAX_FILE_ENTRY_COUNT 4096
+#endif
+
+//NOTE(alg): number of decoded solid blocks the reader keeps in memory
+#define BLOCK_CACHE_SLOT_COUNT 16
+
+//NOTE(alg): number of (type, directory) groups that can have an open solid block at the same time
+#define MAX_OPEN_BLOCK_COUNT 64
+
+//NOTE(alg): limits for split packed files, and number of threads writing/reading volumes concurrently
+#define MAX_VOLUME_COUNT 1024
+#define MAX_VOLUME_DIR_COUNT 16
+#define VOLUME_THREAD_COUNT 8
+
 u32 const MAGIC = 0xDEADBEEF;
+u32 const PACK_VERSION = 3;
 
-FileEntry fileEntries[4096];
-u64 fileOffsets[4096];
+u32 const NO_BLOCK = 0xFFFFFFFF;
+u32 const SOLID_BLOCK_DEFAULT_SIZE = 64*1024;
+u32 const SOLID_ENTRY_MAX_SIZE = 4*1024; //NOTE(alg): only files smaller than this are grouped into solid blocks
+
+u32 const NO_EXTENTS = 0xFFFFFFFF; //NOTE(alg): file is stored dense, i.e. without an extent list
+u64 const SPARSE_MIN_FILE_SIZE = 1024*1024; //NOTE(alg): smaller files are never scanned for holes
+u32 const SPARSE_GRANULE_SIZE = 64*1024; //NOTE(alg): smallest hole that is detected, matches the NTFS sparse allocation unit
+u32 const PACK_READ_CHUNK_SIZE = 16*SPARSE_GRANULE_SIZE; //NOTE(alg): files are read (and scanned) in chunks of this size
+
+FileEntry fileEntries[MAX_FILE_ENTRY_COUNT];
+u64 fileOffsets[MAX_FILE_ENTRY_COUNT]; //NOTE(alg): offset within the solid block, or from file start if not in a block
+u32 fileBlocks[MAX_FILE_ENTRY_COUNT];
 u32 fileEntryCount;
 
+u64 blockOffsets[MAX_FILE_ENTRY_COUNT];
+u64 blockSizes[MAX_FILE_ENTRY_COUNT];
+u32 blockLastEntries[MAX_FILE_ENTRY_COUNT]; //NOTE(alg): packer only, the block is complete once this file is read
+u32 blockCount;
+
+struct FileExtent
+{
+    u64 offset; //NOTE(alg): logical offset within the original file
+    u64 size;
+};
+
+FileExtent* fileExtents; //NOTE(alg): grows as needed, see reserveExtents
+u32 extentCapacity;
+u32 fileFirstExtents[MAX_FILE_ENTRY_COUNT];
+u32 fileExtentCounts[MAX_FILE_ENTRY_COUNT];
+u32 extentCount;
+
+u64 volumeSize; //NOTE(alg): 0 if the packed file is not split into volumes
+u32 volumeCount;
+char volumeDirs[MAX_VOLUME_DIR_COUNT][MAX_PATH];
+u32 volumeDirCount;
+
+//NOTE(alg): returns false if any file or directory had to be skipped, the list is incomplete then
 static
-void findFilesRecursively(char const * basePath, char const * subPath, FileEntry* files, u32* fileCount)
+bool findFilesRecursively(char const * basePath, char const * subPath, FileEntry* files, u32* fileCount)
 {
+    bool result = true;
     u32 subPathLen = stringLength(subPath);
     if(stringLength(basePath) + subPathLen + (subPathLen > 0 ? 1 : 0) >= MAX_PATH)
     {
         printf("Error: path too long\n");
-        return;
+        return false;
     }
     
     char absolutePath[MAX_PATH] = {};
@@ -159,6 +218,7 @@ void findFilesRecursively(char const * basePath, char const * subPath, FileEntry
         {
             DWORD err = GetLastError();
             printf("Could not find %s (%d)\n", absolutePath, err);
+            result = false;
         }
         else
         {
@@ -178,7 +238,7 @@ void findFilesRecursively(char const * basePath, char const * subPath, FileEntry
                         
                         if(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
                         {
-                            findFilesRecursively(basePath, relPath, files, fileCount);
+                            result = findFilesRecursively(basePath, relPath, files, fileCount) && result;
                         }
                         else
                         {
@@ -190,7 +250,12 @@ void findFilesRecursively(char const * basePath, char const * subPath, FileEntry
                             }
                             #endif
                             
-                            if(fileType == FT_ANY)
+                            if(*fileCount >= MAX_FILE_ENTRY_COUNT)
+                            {
+                                printf("Error: too many files, skipping %s\n", relPath);
+                                result = false;
+                            }
+                            else if(fileType == FT_ANY)
                             {                          
                                 LARGE_INTEGER fileSize;
                                 fileSize.LowPart = findData.nFileSizeLow;
@@ -199,7 +264,6 @@ void findFilesRecursively(char const * basePath, char const * subPath, FileEntry
                                 FileEntry newEntry = {};
                                 stringCopy(newEntry.path, relPath, MAX_PATH, MAX_PATH);
                                 newEntry.pathLen = stringLength(relPath) + 1; //NOTE(alg): null-termination
-                                stringCopy(newEntry.name, findData.cFileName, MAX_PATH, MAX_PATH);
                                 newEntry.nameLen = stringLength(findData.cFileName) + 1; //NOTE(alg): null-termination;
                                 newEntry.size = fileSize.QuadPart;
                                 newEntry.type = fileType;
@@ -208,6 +272,11 @@ void findFilesRecursively(char const * basePath, char const * subPath, FileEntry
                             }
                         }
                     }
+                    else
+                    {
+                        printf("Error: path too long, skipping %s\n", findData.cFileName);
+                        result = false;
+                    }
                 }
             } while(FindNextFile(findHandle, &findData) != 0);
             
@@ -219,392 +288,1765 @@ void findFilesRecursively(char const * basePath, char const * subPath, FileEntry
     else
     {
         printf("\nDirectory path is too long.\n");
+        result = false;
     }    
+    return result;
 }
 
 static
-bool packIntoBufferAndWriteFile(char const * basePath, char const * packFileName)
+bool isSolidCandidate(FileEntry* entry, u32 blockSize)
 {
-    bool result = true;
-    
-    // NOTE(alg): file header
-    
-    // Any client always reads the complete header, can therefore build table and do random access to packed file.
-    // Optionally, can read whole file at once.
-    
-    //File Format:
-    // 1. Magic number (identifies file as packed file): 4 bytes
-    // 2. Version (for backwards-compatibility): 4 bytes
-    // 3. Header Size (number of bytes from file start to beginning of actual file data): 4 bytes
-    // For each file:
-    //    4. type: 4 bytes
-    //    5. nameLength (includes null-terminator): 4 bytes
-    //    6. name (ANSI, null-terminated): <nameLength> bytes
-    //    7. pathLength (includes null-terminator): 4 bytes
-    //    8. path (ANSI, null-terminated): <pathLength> bytes
-    //    9. offset (where actual file data starts within the file): 8 bytes
-    //  10. size (of actual file data, i.e. the original file size, excluding null-terminator): 8 bytes
-    // 11. Actual file data, tightly packed
-    
-    u64 packFileHeaderSize = sizeof(u32) + sizeof(u32) + sizeof(u32);
-    for(u32 i=0; i<fileEntryCount; ++i)
-    {
-        FileEntry* entry = fileEntries + i;
-        packFileHeaderSize += sizeof(u32) + sizeof(u32)  + entry->nameLen
-            + sizeof(u32) + entry->pathLen + sizeof(u64) + sizeof(u64);
-    }
-    
-    u64 sizeOffset = packFileHeaderSize;
-    for(u32 i=0; i<fileEntryCount; ++i)
-    {
-        fileOffsets[i] = sizeOffset;
-        sizeOffset += fileEntries[i].size + 1 /*+null-terminator*/;
-    }
+    u64 storedSize = entry->size + 1; //NOTE(alg): null-termination
+    return storedSize <= SOLID_ENTRY_MAX_SIZE && storedSize <= blockSize;
+}
 
-    u64 totalBufferSize = sizeOffset;
-    void* filesBuffer = malloc(totalBufferSize);
-    
-    void* fileHeader = filesBuffer;
-    u32 version = 0;
-    u64 offset = 0;
-    memcpy((char*)fileHeader + offset, &MAGIC, sizeof(u32));
-    offset += sizeof(u32);
-    memcpy((char*)fileHeader + offset, &version, sizeof(u32)); 
-    offset += sizeof(u32);
-    memcpy((char*)fileHeader + offset, &packFileHeaderSize, sizeof(u32));
-    offset += sizeof(u32);
-    
-    for(u32 i=0; i<fileEntryCount; ++i)
-    {
-        FileEntry* entry = fileEntries + i;
-        
-        u32 fileType = (u32)entry->type;
-        memcpy((char*)fileHeader + offset, &fileType, sizeof(u32));
-        offset += sizeof(u32);
-        memcpy((char*)fileHeader + offset, &entry->nameLen, sizeof(u32));
-        offset += sizeof(u32);
-        memcpy((char*)fileHeader + offset, entry->name, entry->nameLen);
-        offset += entry->nameLen;
-        memcpy((char*)fileHeader + offset, &entry->pathLen, sizeof(u32));
-        offset += sizeof(u32);
-        memcpy((char*)fileHeader + offset, entry->path, entry->pathLen);
-        offset += entry->pathLen;
-        memcpy((char*)fileHeader + offset, &entry->size, sizeof(u64));
-        offset += sizeof(u64);
-        memcpy((char*)fileHeader + offset, &fileOffsets[i], sizeof(u64));
-        offset += sizeof(u64);
-    }
-    RP_ASSERT(offset == packFileHeaderSize);
+static
+bool inSameSolidGroup(FileEntry* A, FileEntry* B)
+{
+    //NOTE(alg): files are grouped by type and by the directory they live in
+    u32 dirLenA = A->pathLen - A->nameLen;
+    u32 dirLenB = B->pathLen - B->nameLen;
+    return A->type == B->type && dirLenA == dirLenB && memcmp(A->path, B->path, dirLenA) == 0;
+}
+
+//NOTE(alg): true if the directory of <A> is <B>'s directory or one of its parents
+static
+bool isInAncestorDirectory(FileEntry* A, FileEntry* B)
+{
+    u32 dirLenA = A->pathLen - A->nameLen;
+    u32 dirLenB = B->pathLen - B->nameLen;
+    return dirLenA <= dirLenB && memcmp(A->path, B->path, dirLenA) == 0;
+}
+
+static
+void assignSolidBlocks(u32 blockSize)
+{
+    //NOTE(alg): one block is kept open per (type, directory) group, so small files of a directory still share
+    //a block when the files of a subdirectory are listed in between. Files are listed depth first, a group
+    //whose directory is not a parent of the current file's directory gets no more files and its block is closed.
+    u32 openBlocks[MAX_OPEN_BLOCK_COUNT];
+    u32 openBlockFirstEntries[MAX_OPEN_BLOCK_COUNT];
+    u32 openBlockCount = 0;
     
+    blockCount = 0;
     for(u32 i=0; i<fileEntryCount; ++i)
     {
         FileEntry* entry = fileEntries + i;
-        printf("%s %ld bytes\n", entry->name, entry->size);
+        fileBlocks[i] = NO_BLOCK;
+        fileOffsets[i] = 0;
+        if(blockSize > 0 && isSolidCandidate(entry, blockSize))
         {
-            char absolutePath[MAX_PATH] = {};
-            stringCopy(absolutePath, basePath, MAX_PATH, MAX_PATH);
-            stringCat(absolutePath, "/", MAX_PATH);
-            stringCat(absolutePath, entry->path, MAX_PATH);
-            
-            HANDLE file = CreateFile(absolutePath, 
-                                     GENERIC_READ,
-                                     FILE_SHARE_READ,
-                                     NULL,
-                                     OPEN_EXISTING,
-                                     NULL,
-                                     NULL);
-            if(file != INVALID_HANDLE_VALUE)
-            {
-                void* fileData = (char*)filesBuffer + fileOffsets[i];
-                
-                DWORD readByteCount = 0;
-                BOOL success = ReadFile(file, fileData, entry->size, &readByteCount, NULL);
-                if(success == TRUE)
+            u32 group = NO_BLOCK;
+            u32 keptCount = 0;
+            for(u32 b=0; b<openBlockCount; ++b)
+            {
+                FileEntry* first = fileEntries + openBlockFirstEntries[b];
+                if(isInAncestorDirectory(first, entry))
                 {
-                    RP_ASSERT(readByteCount == entry->size);
-                    char* fileStr = (char*)fileData;
-                    //NOTE(alg): do sth with file contents here, e.g. obfuscate/cipher the contents
-                    fileStr[entry->size] = 0; //NOTE(alg): null-terminate
+                    if(inSameSolidGroup(first, entry))
+                    {
+                        group = keptCount;
+                    }
+                    openBlocks[keptCount] = openBlocks[b];
+                    openBlockFirstEntries[keptCount] = openBlockFirstEntries[b];
+                    ++keptCount;
                 }
-                else
+            }
+            openBlockCount = keptCount;
+            
+            u64 storedSize = entry->size + 1; //NOTE(alg): null-termination
+            bool startBlock = group == NO_BLOCK || blockSizes[openBlocks[group]] + storedSize > blockSize;
+            if(group == NO_BLOCK)
+            {
+                if(openBlockCount == MAX_OPEN_BLOCK_COUNT)
                 {
-                    printf("Error reading file %s\n", entry->name);
-                    result  = false;
+                    //NOTE(alg): very deep trees, close the outermost group
+                    memmove(openBlocks, openBlocks + 1, (openBlockCount - 1) * sizeof(u32));
+                    memmove(openBlockFirstEntries, openBlockFirstEntries + 1, (openBlockCount - 1) * sizeof(u32));
+                    --openBlockCount;
                 }
-                CloseHandle(file);
+                group = openBlockCount++;
             }
-            else
+            if(startBlock)
             {
-                printf("Error creating file %s\n", entry->name);
-                result = false;
+                openBlocks[group] = blockCount++;
+                openBlockFirstEntries[group] = i;
+                blockSizes[openBlocks[group]] = 0;
             }
+            u32 block = openBlocks[group];
+            fileBlocks[i] = block;
+            fileOffsets[i] = blockSizes[block];
+            blockSizes[block] += storedSize;
+            blockLastEntries[block] = i;
         }
     }
-    
-    int ri = (int)strlen(packFileName);
-    while(packFileName[ri] != '\\' && packFileName[ri] != '/' && ri > 0) --ri;
-    char packFileDir[MAX_PATH] = {};
-    memcpy(packFileDir, packFileName, ri);
-    BOOL createDirResult = CreateDirectory(packFileDir, NULL);
-    HANDLE outputFile = CreateFile(packFileName, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-    if(outputFile == INVALID_HANDLE_VALUE)
+}
+
+static
+bool readFileRange(HANDLE file, u64 offset, void* dest, u64 size)
+{
+    LARGE_INTEGER distance;
+    distance.QuadPart = offset;
+    bool result = SetFilePointerEx(file, distance, NULL, FILE_BEGIN) == TRUE;
+    while(result && size > 0)
     {
-        printf("Error: Could not create file %s\n", packFileName);
-        result = false;
+        DWORD chunkSize = size > (1u << 30) ? (1u << 30) : (DWORD)size;
+        DWORD readByteCount = 0;
+        result = ReadFile(file, dest, chunkSize, &readByteCount, NULL) == TRUE && readByteCount == chunkSize;
+        dest = (char*)dest + chunkSize;
+        size -= chunkSize;
     }
-    else
+    return result;
+}
+
+static
+bool writeFileRange(HANDLE file, u64 offset, void const * data, u64 size)
+{
+    LARGE_INTEGER distance;
+    distance.QuadPart = offset;
+    bool result = SetFilePointerEx(file, distance, NULL, FILE_BEGIN) == TRUE;
+    while(result && size > 0)
     {
+        DWORD chunkSize = size > (1u << 30) ? (1u << 30) : (DWORD)size;
         DWORD writtenByteCount = 0;
-        BOOL writeSuccess = WriteFile(outputFile, filesBuffer, totalBufferSize, &writtenByteCount, NULL);
-        if(writeSuccess == TRUE)
+        result = WriteFile(file, data, chunkSize, &writtenByteCount, NULL) == TRUE && writtenByteCount == chunkSize;
+        data = (char const *)data + chunkSize;
+        size -= chunkSize;
+    }
+    return result;
+}
+
+static
+bool isZeroMemory(void const * data, u64 size)
+{
+    u8 const * at = (u8 const *)data;
+    u8 const * end = at + size;
+    __m128i zero = _mm_setzero_si128();
+    while(at + 64 <= end)
+    {
+        __m128i a = _mm_loadu_si128((__m128i const *)at);
+        __m128i b = _mm_loadu_si128((__m128i const *)(at + 16));
+        __m128i c = _mm_loadu_si128((__m128i const *)(at + 32));
+        __m128i d = _mm_loadu_si128((__m128i const *)(at + 48));
+        __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF)
         {
-            RP_ASSERT(totalBufferSize == writtenByteCount);
+            return false;
         }
-        else
+        at += 64;
+    }
+    while(at < end)
+    {
+        if(*(at++))
         {
-            printf("Error: could not write file %s\n", packFileName);
-            result = false;
+            return false;
         }
-        CloseHandle(outputFile);
     }
-    free(filesBuffer);
-    return result;
+    return true;
 }
 
 static
-void createDirectoriesRecursively(char const * pathToFile)
+bool reserveExtents(u64 count)
 {
-    bool delimiterFound = false;
-    u32 lastAt = -1;
-    do
+    if(extentCount + count > extentCapacity)
     {
-        u32 at = stringFindSubstring(lastAt + 1  + pathToFile, "/");
-        if(at == -1)
+        u64 newCapacity = extentCapacity > 0 ? 2 * (u64)extentCapacity : 1024;
+        if(newCapacity < extentCount + count)
         {
-            at = stringFindSubstring(lastAt + 1 + pathToFile, "\\");
+            newCapacity = extentCount + count;
         }
-        delimiterFound = at != -1 && at > 0;  //NOTE(alg): path starting with "\\" is not allowed -> no network paths!
-        if(delimiterFound)
+        if(newCapacity > 0xFFFFFFFE)
         {
-            char dir[MAX_PATH] = {};
-            stringCopy(dir, pathToFile, MAX_PATH, lastAt + at);
-            BOOL success = CreateDirectory(dir, NULL);
-            if(success == TRUE)
-            {
-                //printf("SUCCESS: %s created.\n", dir);
-            }
-            else
-            {
-                DWORD err = GetLastError();
-                if(err == ERROR_ALREADY_EXISTS)
-                {
-                    //printf("WARNING: %s already exists!\n", dir);
-                }
-                else
-                {
-                    printf("ERROR: while creating %s\n", dir);
-                }
-            }
+            return false;
         }
-        lastAt += at + 1;
-    } while(delimiterFound);
+        FileExtent* newExtents = (FileExtent*)realloc(fileExtents, newCapacity * sizeof(FileExtent));
+        if(!newExtents)
+        {
+            return false;
+        }
+        fileExtents = newExtents;
+        extentCapacity = (u32)newCapacity;
+    }
+    return true;
 }
 
-//NOTE(alg): an extractor could choose to read only the first 12 bytes to know the header size
-//then it could only read the header, and read the files from disk on demand!
+//NOTE(alg): appends to the extents of the file that starts at <firstExtent>, merging adjacent ranges
+inline
+bool appendExtent(u32 firstExtent, u64 offset, u64 size)
+{
+    if(extentCount > firstExtent && fileExtents[extentCount - 1].offset + fileExtents[extentCount - 1].size == offset)
+    {
+        fileExtents[extentCount - 1].size += size;
+        return true;
+    }
+    if(reserveExtents(1))
+    {
+        fileExtents[extentCount].offset = offset;
+        fileExtents[extentCount].size = size;
+        ++extentCount;
+        return true;
+    }
+    return false;
+}
 
-void readFileAndExtractToDisk(char const * packFilePath, char const * targetDir)
-{   
-    WIN32_FIND_DATA findData;
-    HANDLE findHandle = FindFirstFileA(packFilePath, &findData);
-    if(findHandle != INVALID_HANDLE_VALUE)
+//NOTE(alg): number of bytes the file occupies in the packed file, excluding null-terminator
+inline
+u64 entryStoredSize(u32 entryIndex)
+{
+    u64 result = fileEntries[entryIndex].size;
+    if(fileExtentCounts[entryIndex] != NO_EXTENTS)
     {
-        HANDLE inputFile = CreateFile(packFilePath, 
-                                      GENERIC_READ,
-                                      FILE_SHARE_READ,
-                                      NULL,
-                                      OPEN_EXISTING,
-                                      NULL,
-                                      NULL);
-        if(inputFile != INVALID_HANDLE_VALUE)
-        { 
-            LARGE_INTEGER inputFileSize;
-            inputFileSize.LowPart = findData.nFileSizeLow;
-            inputFileSize.HighPart = findData.nFileSizeHigh;
-            
-            void* inputFileBuffer = malloc(inputFileSize.QuadPart);
-            if(inputFileBuffer)
-            {
-                DWORD readByteCount = 0;
-                BOOL success = ReadFile(inputFile, inputFileBuffer, inputFileSize.QuadPart, &readByteCount, NULL);
-                if(success  == TRUE)
-                {
-                    RP_ASSERT(inputFileSize.QuadPart == readByteCount);
-                    u64 offset = 0;
-                    u32 magic = 0;
-                    memcpy(&magic,  (char*)inputFileBuffer + offset, sizeof(u32));
-                    offset += sizeof(u32);
-                    RP_ASSERT(magic == MAGIC);
-                    u32 version = 0;
-                    memcpy(&version, (char*)inputFileBuffer + offset, sizeof(u32));
-                    offset += sizeof(32);
-                    RP_ASSERT(version == 0);
-                    u32 headerSize = 0;
-                    memcpy(&headerSize, (char*)inputFileBuffer + offset, sizeof(u32));
-                    offset += sizeof(u32);
-                    while(offset < headerSize)
-                    {
-                        FileEntry* entry = fileEntries + fileEntryCount;
-                        
-                        u32 fileType = 0;
-                        memcpy(&fileType, (char*)inputFileBuffer + offset, sizeof(u32));
-                        offset += sizeof(u32);
-                        entry->type = (FileType)fileType;
-                        memcpy(&entry->nameLen, (char*)inputFileBuffer + offset, sizeof(u32));
-                        offset += sizeof(u32);
-                        memcpy(entry->name, (char*)inputFileBuffer + offset, entry->nameLen);
-                        offset += entry->nameLen;
-                        memcpy(&entry->pathLen, (char*)inputFileBuffer + offset, sizeof(u32));
-                        offset += sizeof(u32);
-                        memcpy(entry->path, (char*)inputFileBuffer + offset, entry->pathLen);
-                        offset += entry->pathLen;
-                        memcpy(&entry->size, (char*)inputFileBuffer + offset, sizeof(u64));
-                        offset += sizeof(u64);
-                        memcpy(&fileOffsets[fileEntryCount], (char*)inputFileBuffer + offset, sizeof(u64));
-                        offset += sizeof(u64);
-                        ++fileEntryCount;
-                    }
-                    
-                    for(u32 i=0; i<fileEntryCount; ++i)
-                    {
-                        FileEntry* entry = fileEntries + i;
-                        printf("%s %ld bytes\n", entry->name, entry->size);
-                        
-                        void* fileContents = (char*)inputFileBuffer + fileOffsets[i];
-                        //NOTE(alg): do sth with file contents here, e.g. de-obfuscate
-                        
-                        char buffer[MAX_PATH] = {};
-                        stringCopy(buffer, targetDir, MAX_PATH, MAX_PATH);
-                        stringCat(buffer, "/", MAX_PATH);
-                        stringCat(buffer, entry->path, MAX_PATH);
-                        
-                        createDirectoriesRecursively(buffer);
-                        
-                        HANDLE outputFile = CreateFile(buffer, 
-                                                       GENERIC_WRITE, 
-                                                       FILE_SHARE_READ, 
-                                                       NULL, 
-                                                       CREATE_ALWAYS, 
-                                                       FILE_ATTRIBUTE_NORMAL, 
-                                                       NULL);
-                        if(outputFile != INVALID_HANDLE_VALUE)
-                        {
-                            DWORD writtenByteCount = 0;
-                            BOOL writeSuccess = WriteFile(outputFile, fileContents, entry->size, &writtenByteCount, NULL); 
-                            RP_ASSERT(entry->size == writtenByteCount);
-                            if(writeSuccess != TRUE)
-                            {
-                                printf("Error: could not write file %s\n", buffer);
-                            }
-                            CloseHandle(outputFile);
-                        }
-                        else
-                        {
-                            printf("Error creating file %s\n", entry->name);
-                        }
-                        
-                    }    
-                }
-                else
-                {
-                    printf("Error: Could not read file %s\n", packFilePath);
-                }
-            }
-        }
-        else
+        result = 0;
+        FileExtent* extents = fileExtents + fileFirstExtents[entryIndex];
+        for(u32 i=0; i<fileExtentCounts[entryIndex]; ++i)
         {
-            printf("Error: cannot create file  %s\n", packFilePath); 
+            result += extents[i].size;
         }
-        FindClose(findHandle);
-    }
-    else
-    {
-        DWORD err = GetLastError();
-        printf("Could not find %s (%d)\n", packFilePath, err);
     }
+    return result;
 }
 
-#if defined PACKER
+inline
+u32 volumeOfOffset(u64 offset)
+{
+    return volumeSize > 0 ? (u32)(offset / volumeSize) : 0;
+}
 
-int main(int argc, const char* argv[])
+//NOTE(alg): volume 0 is the packed file itself. Volume n is named <packed file name>.NNN (n with at least three digits) and lives in
+//volume directory (n-1) modulo the directory count, or next to the packed file if there are none.
+static
+void getVolumePath(char* dest, char const * packFilePath, u32 volumeIndex, bool useVolumeDirs)
 {
-    fileEntryCount = 0;
-    
-    if(argc < 3)
+    stringCopy(dest, packFilePath, MAX_PATH, MAX_PATH);
+    if(volumeIndex > 0)
     {
-        printf("Usage: filepacker <path-to-source-directory> <path-to-target-file>\n");
-        printf("Example: filepacker C:/myDir C:/packedMyDir.bin\n");
-        return -1;
+        int ri = (int)strlen(packFilePath);
+        while(packFilePath[ri] != '\\' && packFilePath[ri] != '/' && ri > 0) --ri;
+        u32 fileNameStart = (packFilePath[ri] == '\\' || packFilePath[ri] == '/') ? ri + 1 : 0;
+        if(useVolumeDirs && volumeDirCount > 0)
+        {
+            stringCopy(dest, volumeDirs[(volumeIndex - 1) % volumeDirCount], MAX_PATH, MAX_PATH);
+            stringCat(dest, "/", MAX_PATH);
+        }
+        else
+        {
+            dest[fileNameStart] = 0;
+        }
+        char suffix[16] = {};
+        sprintf(suffix, ".%03u", volumeIndex);
+        stringCat(dest, packFilePath + fileNameStart, MAX_PATH);
+        stringCat(dest, suffix, MAX_PATH);
     }
-    //NOTE(alg): may not contain trailing backslash!!
-    char const* sourceDirPath = argv[1];
-    
-    findFilesRecursively(sourceDirPath, "", fileEntries, &fileEntryCount);
-    
-    char const* targetFilePath = argv[2];
-    bool result = packIntoBufferAndWriteFile(sourceDirPath, targetFilePath);
-    return result ? 0 : -1;
 }
 
-#elif defined UNPACKER
+u64 const PACK_WRITE_BUFFER_SIZE = 64*1024*1024; //NOTE(alg): largest piece of the packed file that is held in memory at once
 
-int main(int argc, const char* argv[])
+//NOTE(alg): a piece of the packed file that a writer thread writes to the volumes it covers
+struct VolumeWriteJob
 {
-    fileEntryCount = 0;
-    
-    if(argc < 3)
+    u8* buffer;
+    u64 start; //NOTE(alg): offset of buffer[0] within the packed file
+    u64 size;
+    char const * packFileName;
+    bool failed;
+};
+
+static
+DWORD WINAPI writeVolumesThread(LPVOID param)
+{
+    VolumeWriteJob* job = (VolumeWriteJob*)param;
+    for(u64 at=0; at<job->size && !job->failed;)
     {
-        printf("Usage: fileunpacker <path-to-packed-file> <path-to-target-directory>\n");
-        printf("Example: fileunpacker C:/packedMyDir.bin C:/unpackedMyDir\n");
-        return -1;
+        u64 offset = job->start + at;
+        u32 volume = volumeOfOffset(offset);
+        u64 volumeOffset = offset - (u64)volume * volumeSize;
+        u64 chunkSize = job->size - at;
+        if(volumeSize > 0 && volumeOffset + chunkSize > volumeSize)
+        {
+            chunkSize = volumeSize - volumeOffset;
+        }
+        
+        //NOTE(alg): the volume was created by the packing thread, other writers may be writing to it as well
+        char volumePath[MAX_PATH] = {};
+        getVolumePath(volumePath, job->packFileName, volume, true);
+        HANDLE outputFile = CreateFile(volumePath, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(outputFile == INVALID_HANDLE_VALUE)
+        {
+            printf("Error: Could not open file %s\n", volumePath);
+            job->failed = true;
+        }
+        else
+        {
+            if(!writeFileRange(outputFile, volumeOffset, job->buffer + at, chunkSize))
+            {
+                printf("Error: could not write file %s\n", volumePath);
+                job->failed = true;
+            }
+            CloseHandle(outputFile);
+        }
+        at += chunkSize;
     }
-    char const* packfilename = argv[1];
-    //NOTE(alg): must point to an existing directory!
-    //NOTE(alg): may not contain trailing backslash!!
-    char const * extractTargetDir = argv[2];
-    readFileAndExtractToDisk(packfilename, extractTargetDir);
     return 0;
 }
 
-#elif defined FILEPACKERTEST
-
-FileEntry filesA[4096];
-FileEntry filesB[4096];
-u32 fileCountA;
-u32 fileCountB;
+//NOTE(alg): the packed file is written front to back. Data is read (and scanned for holes) directly into
+//the end of the stream, so every byte of a source file is read exactly once. Full buffers are handed to
+//writer threads, so at most VOLUME_THREAD_COUNT + 1 buffers are in memory, however large the packed file is.
+struct PackStream
+{
+    u8* buffer;
+    u64 capacity;
+    u64 used;
+    u64 start; //NOTE(alg): offset of buffer[0] within the packed file
+    char const * packFileName;
+    u32 createdVolumeCount;
+    bool failed;
+    VolumeWriteJob jobs[VOLUME_THREAD_COUNT];
+    HANDLE threads[VOLUME_THREAD_COUNT]; //NOTE(alg): 0 if the job slot is free
+};
 
-u32 findFileIn(char const * relPath, FileEntry* files, u32 fileCount)
+static
+bool beginPackStream(PackStream* stream, char const * packFileName)
 {
-    for(u32 i=0; i<fileCount; ++i)
+    *stream = {};
+    stream->packFileName = packFileName;
+    //NOTE(alg): with small volumes, consecutive buffers go to different volumes (and volume directories),
+    //so the writer threads don't queue up on the same disk
+    stream->capacity = volumeSize > 0 && volumeSize < PACK_WRITE_BUFFER_SIZE ? volumeSize : PACK_WRITE_BUFFER_SIZE;
+    if(stream->capacity < PACK_READ_CHUNK_SIZE)
     {
-        FileEntry* f = files + i;
-        if(stringEqual(relPath, f->path))
-        {
-            return i;
-        }  
+        stream->capacity = PACK_READ_CHUNK_SIZE;
     }
-    return -1;
+    stream->buffer = (u8*)malloc(stream->capacity);
+    if(!stream->buffer)
+    {
+        printf("Error: out of memory while packing\n");
+        return false;
+    }
+    return true;
 }
 
+//NOTE(alg): hands the filled part of the buffer to a writer thread and continues with a free buffer
 static
-bool compareDirectoryTreeContents(char const * A, char const * B)
+bool flushPackStream(PackStream* stream)
 {
-    bool result = true;
-    findFilesRecursively(A, "", filesA, &fileCountA);
-    findFilesRecursively(B, "", filesB, &fileCountB);
-    if(fileCountA == fileCountB)
+    if(stream->failed || stream->used == 0)
     {
-        for(u32 i=0; i<fileCountA; ++i)
+        return !stream->failed;
+    }
+    
+    u64 end = stream->start + stream->used;
+    u32 lastVolume = volumeOfOffset(end - 1);
+    if(lastVolume >= MAX_VOLUME_COUNT)
+    {
+        printf("Error: more than %u volumes needed, increase the volume size\n", MAX_VOLUME_COUNT);
+        stream->failed = true;
+        return false;
+    }
+    for(; stream->createdVolumeCount <= lastVolume; ++stream->createdVolumeCount)
+    {
+        char volumePath[MAX_PATH] = {};
+        getVolumePath(volumePath, stream->packFileName, stream->createdVolumeCount, true);
+        HANDLE outputFile = CreateFile(volumePath, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(outputFile == INVALID_HANDLE_VALUE)
+        {
+            printf("Error: Could not create file %s\n", volumePath);
+            stream->failed = true;
+            return false;
+        }
+        CloseHandle(outputFile);
+    }
+    
+    u32 slot = VOLUME_THREAD_COUNT;
+    for(u32 i=0; i<VOLUME_THREAD_COUNT && slot == VOLUME_THREAD_COUNT; ++i)
+    {
+        if(!stream->threads[i])
+        {
+            slot = i;
+        }
+    }
+    if(slot == VOLUME_THREAD_COUNT)
+    {
+        slot = WaitForMultipleObjects(VOLUME_THREAD_COUNT, stream->threads, FALSE, INFINITE) - WAIT_OBJECT_0;
+        CloseHandle(stream->threads[slot]);
+        stream->threads[slot] = 0;
+        stream->failed |= stream->jobs[slot].failed;
+    }
+    
+    VolumeWriteJob* job = stream->jobs + slot;
+    u8* freeBuffer = job->buffer;
+    job->buffer = stream->buffer;
+    job->start = stream->start;
+    job->size = stream->used;
+    job->packFileName = stream->packFileName;
+    stream->threads[slot] = CreateThread(NULL, 0, writeVolumesThread, job, 0, NULL);
+    if(!stream->threads[slot])
+    {
+        writeVolumesThread(job);
+        stream->failed |= job->failed;
+    }
+    
+    stream->start = end;
+    stream->used = 0;
+    stream->buffer = freeBuffer ? freeBuffer : (u8*)malloc(stream->capacity);
+    if(!stream->buffer)
+    {
+        printf("Error: out of memory while packing\n");
+        stream->failed = true;
+    }
+    return !stream->failed;
+}
+
+//NOTE(alg): writes what is left in the stream (unless packing failed), waits for the writer threads and frees all buffers
+static
+bool endPackStream(PackStream* stream)
+{
+    if(!stream->failed)
+    {
+        flushPackStream(stream);
+    }
+    for(u32 i=0; i<VOLUME_THREAD_COUNT; ++i)
+    {
+        if(stream->threads[i])
+        {
+            WaitForMultipleObjects(1, stream->threads + i, TRUE, INFINITE);
+            CloseHandle(stream->threads[i]);
+            stream->threads[i] = 0;
+        }
+        stream->failed |= stream->jobs[i].failed;
+        free(stream->jobs[i].buffer);
+        stream->jobs[i].buffer = 0;
+    }
+    free(stream->buffer);
+    stream->buffer = 0;
+    return !stream->failed;
+}
+
+//NOTE(alg): returns room for <size> bytes (at most PACK_READ_CHUNK_SIZE) at the end of the stream, which is filled
+//by the caller and then committed with commitStreamBytes. Returns 0 if packing failed.
+static
+u8* reserveStreamBytes(PackStream* stream, u64 size)
+{
+    RP_ASSERT(size <= stream->capacity);
+    if(stream->used + size > stream->capacity && !flushPackStream(stream))
+    {
+        return 0;
+    }
+    return stream->failed ? 0 : stream->buffer + stream->used;
+}
+
+inline
+void commitStreamBytes(PackStream* stream, u64 size)
+{
+    stream->used += size;
+}
+
+inline
+u64 streamOffset(PackStream* stream)
+{
+    return stream->start + stream->used;
+}
+
+static
+bool appendStreamBytes(PackStream* stream, void const * data, u64 size)
+{
+    while(size > 0)
+    {
+        u64 chunkSize = size < PACK_READ_CHUNK_SIZE ? size : PACK_READ_CHUNK_SIZE;
+        u8* dest = reserveStreamBytes(stream, chunkSize);
+        if(!dest)
+        {
+            return false;
+        }
+        memcpy(dest, data, chunkSize);
+        commitStreamBytes(stream, chunkSize);
+        data = (char const *)data + chunkSize;
+        size -= chunkSize;
+    }
+    return true;
+}
+
+//NOTE(alg): appends the data of a file that is not in a solid block to the stream and records its extents.
+//For files of at least SPARSE_MIN_FILE_SIZE, unallocated ranges reported by the file system are skipped
+//without reading them, and zero-filled granules of the allocated ranges are dropped right after reading,
+//so that preallocated files which are not actually sparse shrink as well.
+//<readSuccess> is false if the file could not be read completely, the unread rest is then stored as a hole.
+//Returns false only if the stream ran out of memory.
+static
+bool packFileData(PackStream* stream, HANDLE file, u32 entryIndex, bool* readSuccess)
+{
+    FileEntry* entry = fileEntries + entryIndex;
+    u64 fileSize = entry->size;
+    bool scan = fileSize >= SPARSE_MIN_FILE_SIZE;
+    u32 firstExtent = extentCount;
+    *readSuccess = true;
+    
+    u64 queryOffset = 0;
+    bool moreRanges = true;
+    while(moreRanges && *readSuccess)
+    {
+        FILE_ALLOCATED_RANGE_BUFFER ranges[64];
+        u32 rangeCount = 0;
+        moreRanges = false;
+        if(scan)
+        {
+            FILE_ALLOCATED_RANGE_BUFFER query;
+            query.FileOffset.QuadPart = queryOffset;
+            query.Length.QuadPart = fileSize - queryOffset;
+            DWORD returnedByteCount = 0;
+            BOOL success = DeviceIoControl(file, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query), 
+                                           ranges, sizeof(ranges), &returnedByteCount, NULL);
+            moreRanges = success != TRUE && GetLastError() == ERROR_MORE_DATA;
+            rangeCount = returnedByteCount / sizeof(FILE_ALLOCATED_RANGE_BUFFER);
+            if(success == TRUE || (moreRanges && rangeCount > 0))
+            {
+                //NOTE(alg): everything up to the end of the last reported range is known
+                queryOffset = success == TRUE ? fileSize : queryOffset;
+            }
+            else
+            {
+                //NOTE(alg): file system cannot report allocated ranges, scan the rest of the file
+                moreRanges = false;
+                rangeCount = 0;
+            }
+        }
+        if(rangeCount == 0 && queryOffset < fileSize)
+        {
+            ranges[0].FileOffset.QuadPart = queryOffset;
+            ranges[0].Length.QuadPart = fileSize - queryOffset;
+            rangeCount = 1;
+        }
+        
+        for(u32 r=0; r<rangeCount && *readSuccess; ++r)
+        {
+            u64 rangeStart = ranges[r].FileOffset.QuadPart;
+            u64 rangeEnd = rangeStart + ranges[r].Length.QuadPart;
+            if(rangeEnd > fileSize)
+            {
+                rangeEnd = fileSize;
+            }
+            for(u64 at = rangeStart; at < rangeEnd && *readSuccess;)
+            {
+                u64 chunkSize = rangeEnd - at < PACK_READ_CHUNK_SIZE ? rangeEnd - at : PACK_READ_CHUNK_SIZE;
+                u8* chunk = reserveStreamBytes(stream, chunkSize);
+                if(!chunk)
+                {
+                    return false;
+                }
+                if(!readFileRange(file, at, chunk, chunkSize))
+                {
+                    *readSuccess = false;
+                    break;
+                }
+                
+                //NOTE(alg): do sth with file contents here, e.g. obfuscate/cipher the contents
+                u64 keptSize = 0;
+                for(u64 g=0; g<chunkSize;)
+                {
+                    u64 granuleEnd = chunkSize;
+                    if(scan)
+                    {
+                        granuleEnd = ((at + g) / SPARSE_GRANULE_SIZE + 1) * SPARSE_GRANULE_SIZE - at;
+                        if(granuleEnd > chunkSize)
+                        {
+                            granuleEnd = chunkSize;
+                        }
+                    }
+                    if(!scan || !isZeroMemory(chunk + g, granuleEnd - g))
+                    {
+                        if(!appendExtent(firstExtent, at + g, granuleEnd - g))
+                        {
+                            printf("Error: out of memory while packing\n");
+                            return false;
+                        }
+                        if(keptSize != g)
+                        {
+                            memmove(chunk + keptSize, chunk + g, granuleEnd - g);
+                        }
+                        keptSize += granuleEnd - g;
+                    }
+                    g = granuleEnd;
+                }
+                commitStreamBytes(stream, keptSize);
+                at += chunkSize;
+            }
+            if(moreRanges)
+            {
+                queryOffset = rangeEnd;
+            }
+        }
+    }
+    
+    fileFirstExtents[entryIndex] = firstExtent;
+    fileExtentCounts[entryIndex] = extentCount - firstExtent;
+    if(fileExtentCounts[entryIndex] == 1 && fileExtents[firstExtent].offset == 0 && fileExtents[firstExtent].size == fileSize)
+    {
+        //NOTE(alg): no holes, store dense
+        fileExtentCounts[entryIndex] = NO_EXTENTS;
+        extentCount = firstExtent;
+    }
+    else if(fileSize == 0)
+    {
+        fileExtentCounts[entryIndex] = NO_EXTENTS;
+    }
+    return true;
+}
+
+static
+bool packIntoBufferAndWriteFile(char const * basePath, char const * packFileName, u32 blockSize, u64 maxVolumeSize)
+{
+    bool result = true;
+    
+    // NOTE(alg): file header
+    
+    // Any client reads the header at the start of the packed file, and from there the index
+    // at its end. With the index, it can do random access to the packed file.
+    // Optionally, can read whole file at once.
+    
+    // Small files of the same type and directory are grouped into solid blocks of at most <blockSize> bytes,
+    // so that a reader can fetch (and later decode) a whole group with a single read.
+    // A <blockSize> of 0 stores every file on its own.
+    // Large files are stored as a list of data extents, zero-filled ranges (holes) are not stored at all.
+    // The extents are only known once a file has been read, which is why the index follows the file data.
+    // With a <maxVolumeSize> > 0, the packed file is cut into volumes of that size, which are written concurrently:
+    // byte N of the packed file lives in volume N / <maxVolumeSize> at offset N % <maxVolumeSize>.
+    // The header always lives in volume 0, all offsets below are counted across volumes.
+    
+    //File Format:
+    // 1. Magic number (identifies file as packed file): 4 bytes
+    // 2. Version (for backwards-compatibility): 4 bytes
+    // 3. Header Size (number of bytes from file start to beginning of actual file data): 4 bytes
+    // 4. Index offset (where the index starts within the file): 8 bytes
+    // 5. Index size: 8 bytes
+    // 6. Volume size (0 if the file is not split): 8 bytes
+    // 7. Volume count: 4 bytes
+    // 8. Volume directory count: 4 bytes
+    // For each volume directory:
+    //    9. dirLength (includes null-terminator): 4 bytes
+    //  10. dir (ANSI, null-terminated): <dirLength> bytes
+    // 11. Actual file data (solid blocks and single files), each file null-terminated, tightly packed.
+    //     The data of a file with extents is the contents of its extents back to back.
+    // Index:
+    // 12. Block count: 4 bytes
+    // For each solid block:
+    //  13. offset (where the block starts within the file): 8 bytes
+    //  14. size (of the block, including the null-terminators of its files): 8 bytes
+    // For each file:
+    //  15. type: 4 bytes
+    //  16. nameLength (includes null-terminator): 4 bytes
+    //  17. name (ANSI, null-terminated): <nameLength> bytes
+    //  18. pathLength (includes null-terminator): 4 bytes
+    //  19. path (ANSI, null-terminated): <pathLength> bytes
+    //  20. size (of actual file data, i.e. the original file size, excluding null-terminator): 8 bytes
+    //  21. block index (0xFFFFFFFF if the file is not part of a solid block): 4 bytes
+    //  22. offset (where actual file data starts within its block, or within the file if not in a block): 8 bytes
+    //  23. extent count (0xFFFFFFFF if the file is stored dense): 4 bytes
+    //  For each extent:
+    //      24. offset (within the original file): 8 bytes
+    //      25. size: 8 bytes
+    
+    assignSolidBlocks(blockSize);
+    extentCount = 0;
+    volumeSize = maxVolumeSize;
+    
+    u64 packFileHeaderSize = sizeof(u32) + sizeof(u32) + sizeof(u32) + sizeof(u64) + sizeof(u64);
+    packFileHeaderSize += sizeof(u64) + sizeof(u32) + sizeof(u32);
+    for(u32 i=0; i<volumeDirCount; ++i)
+    {
+        packFileHeaderSize += sizeof(u32) + stringLength(volumeDirs[i]) + 1;
+    }
+    if(volumeSize > 0 && volumeSize < packFileHeaderSize)
+    {
+        printf("Error: volume size must be at least %llu bytes to hold the header\n", packFileHeaderSize);
+        return false;
+    }
+    
+    int ri = (int)strlen(packFileName);
+    while(packFileName[ri] != '\\' && packFileName[ri] != '/' && ri > 0) --ri;
+    char packFileDir[MAX_PATH] = {};
+    memcpy(packFileDir, packFileName, ri);
+    BOOL createDirResult = CreateDirectory(packFileDir, NULL);
+    for(u32 i=0; i<volumeDirCount; ++i)
+    {
+        CreateDirectory(volumeDirs[i], NULL);
+    }
+    
+    PackStream stream;
+    bool streamOk = beginPackStream(&stream, packFileName);
+    u8** blockBuffers = (u8**)calloc(blockCount > 0 ? blockCount : 1, sizeof(u8*));
+    u8* header = streamOk ? reserveStreamBytes(&stream, packFileHeaderSize) : 0;
+    if(!blockBuffers)
+    {
+        printf("Error: out of memory while packing\n");
+    }
+    streamOk = blockBuffers && header;
+    if(streamOk)
+    {
+        //NOTE(alg): written once the index offset is known
+        memset(header, 0, packFileHeaderSize);
+        commitStreamBytes(&stream, packFileHeaderSize);
+    }
+    
+    for(u32 i=0; i<fileEntryCount && streamOk; ++i)
+    {
+        FileEntry* entry = fileEntries + i;
+        printf("%s %llu bytes\n", entryName(entry), entry->size);
+        
+        u32 block = fileBlocks[i];
+        u8* blockData = 0;
+        if(block != NO_BLOCK)
+        {
+            fileFirstExtents[i] = extentCount;
+            fileExtentCounts[i] = NO_EXTENTS;
+            if(!blockBuffers[block])
+            {
+                blockBuffers[block] = (u8*)calloc(blockSizes[block], 1);
+            }
+            blockData = blockBuffers[block];
+            streamOk = blockData != 0;
+            if(!streamOk)
+            {
+                printf("Error: out of memory while packing\n");
+                break;
+            }
+        }
+        else
+        {
+            fileOffsets[i] = streamOffset(&stream);
+            fileFirstExtents[i] = extentCount;
+            fileExtentCounts[i] = 0; //NOTE(alg): stored as a hole if it cannot be read
+        }
+        
+        char absolutePath[MAX_PATH] = {};
+        stringCopy(absolutePath, basePath, MAX_PATH, MAX_PATH);
+        stringCat(absolutePath, "/", MAX_PATH);
+        stringCat(absolutePath, entry->path, MAX_PATH);
+        
+        HANDLE file = CreateFile(absolutePath, 
+                                 GENERIC_READ,
+                                 FILE_SHARE_READ,
+                                 NULL,
+                                 OPEN_EXISTING,
+                                 NULL,
+                                 NULL);
+        if(file != INVALID_HANDLE_VALUE)
+        {
+            bool success = true;
+            if(blockData)
+            {
+                //NOTE(alg): do sth with file contents here, e.g. obfuscate/cipher the contents
+                success = readFileRange(file, 0, blockData + fileOffsets[i], entry->size);
+            }
+            else
+            {
+                streamOk = packFileData(&stream, file, i, &success);
+            }
+            if(!success)
+            {
+                printf("Error reading file %s\n", entryName(entry));
+                result  = false;
+            }
+            CloseHandle(file);
+        }
+        else
+        {
+            printf("Error creating file %s\n", entryName(entry));
+            result = false;
+        }
+        
+        if(blockData)
+        {
+            blockData[fileOffsets[i] + entry->size] = 0; //NOTE(alg): null-terminate
+            if(blockLastEntries[block] == i)
+            {
+                blockOffsets[block] = streamOffset(&stream);
+                streamOk = appendStreamBytes(&stream, blockData, blockSizes[block]);
+                free(blockData);
+                blockBuffers[block] = 0;
+            }
+        }
+        else if(streamOk)
+        {
+            u8 nullTerminator = 0;
+            streamOk = appendStreamBytes(&stream, &nullTerminator, 1);
+        }
+    }
+    
+    u64 indexOffset = streamOffset(&stream);
+    for(u32 i=0; i<blockCount && streamOk; ++i)
+    {
+        if(i == 0)
+        {
+            streamOk = appendStreamBytes(&stream, &blockCount, sizeof(u32));
+        }
+        streamOk = streamOk
+            && appendStreamBytes(&stream, &blockOffsets[i], sizeof(u64))
+            && appendStreamBytes(&stream, &blockSizes[i], sizeof(u64));
+    }
+    if(blockCount == 0 && streamOk)
+    {
+        streamOk = appendStreamBytes(&stream, &blockCount, sizeof(u32));
+    }
+    
+    for(u32 i=0; i<fileEntryCount && streamOk; ++i)
+    {
+        FileEntry* entry = fileEntries + i;
+        u32 fileType = (u32)entry->type;
+        streamOk = appendStreamBytes(&stream, &fileType, sizeof(u32))
+            && appendStreamBytes(&stream, &entry->nameLen, sizeof(u32))
+            && appendStreamBytes(&stream, entryName(entry), entry->nameLen)
+            && appendStreamBytes(&stream, &entry->pathLen, sizeof(u32))
+            && appendStreamBytes(&stream, entry->path, entry->pathLen)
+            && appendStreamBytes(&stream, &entry->size, sizeof(u64))
+            && appendStreamBytes(&stream, &fileBlocks[i], sizeof(u32))
+            && appendStreamBytes(&stream, &fileOffsets[i], sizeof(u64))
+            && appendStreamBytes(&stream, &fileExtentCounts[i], sizeof(u32));
+        if(streamOk && fileExtentCounts[i] != NO_EXTENTS)
+        {
+            streamOk = appendStreamBytes(&stream, fileExtents + fileFirstExtents[i], 
+                                         fileExtentCounts[i] * sizeof(FileExtent));
+        }
+    }
+    u64 indexSize = streamOffset(&stream) - indexOffset;
+    
+    u64 totalBufferSize = streamOffset(&stream);
+    volumeCount = volumeOfOffset(totalBufferSize - 1) + 1;
+    if(blockBuffers)
+    {
+        for(u32 i=0; i<blockCount; ++i)
+        {
+            free(blockBuffers[i]);
+        }
+        free(blockBuffers);
+    }
+    if(!streamOk)
+    {
+        stream.failed = true;
+    }
+    if(!endPackStream(&stream))
+    {
+        return false;
+    }
+    
+    u8* fileHeader = (u8*)malloc(packFileHeaderSize);
+    if(!fileHeader)
+    {
+        printf("Error: out of memory while packing\n");
+        return false;
+    }
+    u32 version = PACK_VERSION;
+    u64 offset = 0;
+    memcpy(fileHeader + offset, &MAGIC, sizeof(u32));
+    offset += sizeof(u32);
+    memcpy(fileHeader + offset, &version, sizeof(u32)); 
+    offset += sizeof(u32);
+    memcpy(fileHeader + offset, &packFileHeaderSize, sizeof(u32));
+    offset += sizeof(u32);
+    memcpy(fileHeader + offset, &indexOffset, sizeof(u64));
+    offset += sizeof(u64);
+    memcpy(fileHeader + offset, &indexSize, sizeof(u64));
+    offset += sizeof(u64);
+    memcpy(fileHeader + offset, &volumeSize, sizeof(u64));
+    offset += sizeof(u64);
+    memcpy(fileHeader + offset, &volumeCount, sizeof(u32));
+    offset += sizeof(u32);
+    memcpy(fileHeader + offset, &volumeDirCount, sizeof(u32));
+    offset += sizeof(u32);
+    for(u32 i=0; i<volumeDirCount; ++i)
+    {
+        u32 dirLen = stringLength(volumeDirs[i]) + 1; //NOTE(alg): null-termination
+        memcpy(fileHeader + offset, &dirLen, sizeof(u32));
+        offset += sizeof(u32);
+        memcpy(fileHeader + offset, volumeDirs[i], dirLen);
+        offset += dirLen;
+    }
+    RP_ASSERT(offset == packFileHeaderSize);
+    
+    //NOTE(alg): the header lives in volume 0, which is complete once all writers are done
+    HANDLE outputFile = CreateFile(packFileName, GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(outputFile == INVALID_HANDLE_VALUE || !writeFileRange(outputFile, 0, fileHeader, packFileHeaderSize))
+    {
+        printf("Error: could not write file %s\n", packFileName);
+        result = false;
+    }
+    if(outputFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(outputFile);
+    }
+    free(fileHeader);
+    return result;
+}
+
+static
+void createDirectoriesRecursively(char const * pathToFile)
+{
+    bool delimiterFound = false;
+    u32 lastAt = -1;
+    do
+    {
+        u32 at = stringFindSubstring(lastAt + 1  + pathToFile, "/");
+        if(at == -1)
+        {
+            at = stringFindSubstring(lastAt + 1 + pathToFile, "\\");
+        }
+        delimiterFound = at != -1 && at > 0;  //NOTE(alg): path starting with "\\" is not allowed -> no network paths!
+        if(delimiterFound)
+        {
+            char dir[MAX_PATH] = {};
+            stringCopy(dir, pathToFile, MAX_PATH, lastAt + at);
+            BOOL success = CreateDirectory(dir, NULL);
+            if(success == TRUE)
+            {
+                //printf("SUCCESS: %s created.\n", dir);
+            }
+            else
+            {
+                DWORD err = GetLastError();
+                if(err == ERROR_ALREADY_EXISTS)
+                {
+                    //printf("WARNING: %s already exists!\n", dir);
+                }
+                else
+                {
+                    printf("ERROR: while creating %s\n", dir);
+                }
+            }
+        }
+        lastAt += at + 1;
+    } while(delimiterFound);
+}
+
+struct BlockCacheSlot
+{
+    u32 blockIndex;
+    u64 lastUse;
+    u64 capacity;
+    void* data;
+};
+
+struct PackReader
+{
+    char packFilePath[MAX_PATH];
+    HANDLE volumes[MAX_VOLUME_COUNT]; //NOTE(alg): opened on first access, so untouched volumes are never opened
+    u32 version;
+    u64 useCounter;
+    BlockCacheSlot cache[BLOCK_CACHE_SLOT_COUNT];
+    void* scratch; //NOTE(alg): PACK_READ_CHUNK_SIZE bytes, see readPackedChunk
+    u64 cacheHitCount;
+    u64 cacheMissCount;
+};
+
+static
+HANDLE getVolumeHandle(PackReader* reader, u32 volumeIndex)
+{
+    HANDLE result = reader->volumes[volumeIndex];
+    if(!result)
+    {
+        char volumePath[MAX_PATH] = {};
+        getVolumePath(volumePath, reader->packFilePath, volumeIndex, true);
+        result = CreateFile(volumePath, 
+                            GENERIC_READ,
+                            FILE_SHARE_READ,
+                            NULL,
+                            OPEN_EXISTING,
+                            NULL,
+                            NULL);
+        if(result == INVALID_HANDLE_VALUE && volumeIndex > 0 && volumeDirCount > 0)
+        {
+            //NOTE(alg): volumes may have been moved next to the packed file
+            getVolumePath(volumePath, reader->packFilePath, volumeIndex, false);
+            result = CreateFile(volumePath, 
+                                GENERIC_READ,
+                                FILE_SHARE_READ,
+                                NULL,
+                                OPEN_EXISTING,
+                                NULL,
+                                NULL);
+        }
+        if(result == INVALID_HANDLE_VALUE)
+        {
+            DWORD err = GetLastError();
+            printf("Could not open %s (%d)\n", volumePath, err);
+        }
+        reader->volumes[volumeIndex] = result;
+    }
+    return result;
+}
+
+static
+bool readPackRange(PackReader* reader, u64 offset, void* dest, u64 size)
+{
+    bool result = true;
+    while(result && size > 0)
+    {
+        u32 volume = volumeOfOffset(offset);
+        u64 volumeOffset = offset - (u64)volume * volumeSize;
+        u64 chunkSize = size;
+        if(volumeSize > 0 && volumeOffset + chunkSize > volumeSize)
+        {
+            chunkSize = volumeSize - volumeOffset;
+        }
+        HANDLE file = volume < volumeCount ? getVolumeHandle(reader, volume) : INVALID_HANDLE_VALUE;
+        result = file != INVALID_HANDLE_VALUE && readFileRange(file, volumeOffset, dest, chunkSize);
+        dest = (char*)dest + chunkSize;
+        offset += chunkSize;
+        size -= chunkSize;
+    }
+    return result;
+}
+
+//NOTE(alg): copies <size> bytes from the header and advances <offset>, fails instead of reading past <end>
+inline
+bool readHeaderBytes(void* dest, void const * header, u64* offset, u64 end, u64 size)
+{
+    if(*offset > end || size > end - *offset)
+    {
+        return false;
+    }
+    memcpy(dest, (char const *)header + *offset, size);
+    *offset += size;
+    return true;
+}
+
+//NOTE(alg): prepares a reader for a packed file whose header has already been read by openPackFile,
+//so that several threads can read from the same packed file with their own handles and block caches
+static
+void attachPackReader(PackReader* reader, char const * packFilePath)
+{
+    stringCopy(reader->packFilePath, packFilePath, MAX_PATH, MAX_PATH);
+    for(u32 i=0; i<BLOCK_CACHE_SLOT_COUNT; ++i)
+    {
+        reader->cache[i].blockIndex = NO_BLOCK;
+    }
+}
+
+//NOTE(alg): only the header and the index are read on open, file data is read from disk on demand.
+//Files in solid blocks are served from a small LRU cache of decoded blocks,
+//so reading neighbouring small files costs one read per block instead of one per file.
+
+static
+bool openPackFile(PackReader* reader, char const * packFilePath)
+{
+    bool result = false;
+    attachPackReader(reader, packFilePath);
+    volumeSize = 0;
+    volumeCount = 1;
+    volumeDirCount = 0;
+    
+    HANDLE file = getVolumeHandle(reader, 0);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    
+    u32 prefix[3] = {};
+    if(!readFileRange(file, 0, prefix, sizeof(prefix)))
+    {
+        printf("Error: Could not read file %s\n", packFilePath);
+        return false;
+    }
+    u32 magic = prefix[0];
+    reader->version = prefix[1];
+    u32 headerSize = prefix[2];
+    if(magic != MAGIC || reader->version > PACK_VERSION || headerSize < sizeof(prefix))
+    {
+        printf("Error: %s is not a packed file of a supported version\n", packFilePath);
+        return false;
+    }
+    
+    void* headerBuffer = malloc(headerSize);
+    if(headerBuffer && readFileRange(file, 0, headerBuffer, headerSize))
+    {
+        result = true;
+        u64 offset = sizeof(prefix);
+        blockCount = 0;
+        extentCount = 0;
+        u64 indexOffset = 0;
+        u64 indexSize = 0;
+        if(reader->version >= 2)
+        {
+            result = readHeaderBytes(&indexOffset, headerBuffer, &offset, headerSize, sizeof(u64))
+                && readHeaderBytes(&indexSize, headerBuffer, &offset, headerSize, sizeof(u64))
+                && indexOffset >= headerSize;
+        }
+        if(reader->version >= 3 && result)
+        {
+            result = readHeaderBytes(&volumeSize, headerBuffer, &offset, headerSize, sizeof(u64))
+                && readHeaderBytes(&volumeCount, headerBuffer, &offset, headerSize, sizeof(u32))
+                && readHeaderBytes(&volumeDirCount, headerBuffer, &offset, headerSize, sizeof(u32))
+                && volumeCount > 0 && volumeCount <= MAX_VOLUME_COUNT && volumeDirCount <= MAX_VOLUME_DIR_COUNT;
+            for(u32 i=0; i<volumeDirCount && result; ++i)
+            {
+                u32 dirLen = 0;
+                result = readHeaderBytes(&dirLen, headerBuffer, &offset, headerSize, sizeof(u32))
+                    && dirLen > 0 && dirLen <= MAX_PATH
+                    && readHeaderBytes(volumeDirs[i], headerBuffer, &offset, headerSize, dirLen)
+                    && volumeDirs[i][dirLen - 1] == 0;
+            }
+            if(!result)
+            {
+                volumeDirCount = 0;
+            }
+        }
+        
+        //NOTE(alg): since version 2, the index follows the file data, before that it is part of the header
+        void* indexBuffer = headerBuffer;
+        u64 indexEnd = headerSize;
+        bool volumeMissing = false;
+        if(reader->version >= 2 && result)
+        {
+            //NOTE(alg): the index lives in the last volume(s), which are therefore always opened
+            u32 lastVolume = volumeOfOffset(indexOffset + (indexSize > 0 ? indexSize - 1 : 0));
+            for(u32 v=volumeOfOffset(indexOffset); v<=lastVolume && v<volumeCount && !volumeMissing; ++v)
+            {
+                volumeMissing = getVolumeHandle(reader, v) == INVALID_HANDLE_VALUE;
+                if(volumeMissing)
+                {
+                    printf("Error: missing volume %u of %s\n", v, packFilePath);
+                }
+            }
+            offset = 0;
+            indexEnd = indexSize;
+            indexBuffer = volumeMissing ? 0 : malloc(indexSize);
+            result = indexBuffer && readPackRange(reader, indexOffset, indexBuffer, indexSize);
+        }
+        
+        //NOTE(alg): file data must lie before the index and within the volumes, otherwise a corrupt offset
+        //would select a volume that does not exist
+        u64 dataEnd = reader->version >= 2 ? indexOffset : (u64)-1;
+        if(volumeSize > 0 && volumeSize <= dataEnd / volumeCount)
+        {
+            dataEnd = volumeCount * volumeSize;
+        }
+        if(reader->version >= 1 && result)
+        {
+            result = readHeaderBytes(&blockCount, indexBuffer, &offset, indexEnd, sizeof(u32))
+                && blockCount <= MAX_FILE_ENTRY_COUNT;
+            for(u32 i=0; i<blockCount && result; ++i)
+            {
+                result = readHeaderBytes(&blockOffsets[i], indexBuffer, &offset, indexEnd, sizeof(u64))
+                    && readHeaderBytes(&blockSizes[i], indexBuffer, &offset, indexEnd, sizeof(u64))
+                    && blockOffsets[i] < dataEnd && blockSizes[i] <= dataEnd - blockOffsets[i];
+            }
+            if(!result)
+            {
+                blockCount = 0;
+            }
+        }
+        
+        while(offset < indexEnd && result)
+        {
+            if(fileEntryCount >= MAX_FILE_ENTRY_COUNT)
+            {
+                printf("Error: too many files in %s\n", packFilePath);
+                result = false;
+                break;
+            }
+            FileEntry* entry = fileEntries + fileEntryCount;
+            
+            u32 fileType = 0;
+            char name[MAX_PATH];
+            result = readHeaderBytes(&fileType, indexBuffer, &offset, indexEnd, sizeof(u32))
+                && readHeaderBytes(&entry->nameLen, indexBuffer, &offset, indexEnd, sizeof(u32))
+                && entry->nameLen > 0 && entry->nameLen <= MAX_PATH
+                && readHeaderBytes(name, indexBuffer, &offset, indexEnd, entry->nameLen)
+                && readHeaderBytes(&entry->pathLen, indexBuffer, &offset, indexEnd, sizeof(u32))
+                && entry->pathLen >= entry->nameLen && entry->pathLen <= MAX_PATH
+                && readHeaderBytes(entry->path, indexBuffer, &offset, indexEnd, entry->pathLen)
+                && memcmp(entryName(entry), name, entry->nameLen) == 0 && entry->path[entry->pathLen - 1] == 0
+                && readHeaderBytes(&entry->size, indexBuffer, &offset, indexEnd, sizeof(u64));
+            entry->type = (FileType)fileType;
+            fileBlocks[fileEntryCount] = NO_BLOCK;
+            if(reader->version >= 1 && result)
+            {
+                result = readHeaderBytes(&fileBlocks[fileEntryCount], indexBuffer, &offset, indexEnd, sizeof(u32));
+            }
+            result = result && readHeaderBytes(&fileOffsets[fileEntryCount], indexBuffer, &offset, indexEnd, sizeof(u64));
+            
+            //NOTE(alg): a file in a solid block must lie completely within it
+            u32 block = fileBlocks[fileEntryCount];
+            if(result && block != NO_BLOCK)
+            {
+                result = block < blockCount
+                    && fileOffsets[fileEntryCount] <= blockSizes[block]
+                    && entry->size < blockSizes[block] - fileOffsets[fileEntryCount];
+            }
+            
+            fileFirstExtents[fileEntryCount] = extentCount;
+            fileExtentCounts[fileEntryCount] = NO_EXTENTS;
+            if(reader->version >= 2 && result)
+            {
+                u32 count = 0;
+                result = readHeaderBytes(&count, indexBuffer, &offset, indexEnd, sizeof(u32));
+                if(result && count != NO_EXTENTS)
+                {
+                    //NOTE(alg): each extent takes 16 header bytes, a count beyond that is corrupt
+                    result = count <= (indexEnd - offset) / (2 * sizeof(u64)) && reserveExtents(count);
+                    for(u32 e=0; e<count && result; ++e)
+                    {
+                        FileExtent* extent = fileExtents + extentCount + e;
+                        result = readHeaderBytes(&extent->offset, indexBuffer, &offset, indexEnd, sizeof(u64))
+                            && readHeaderBytes(&extent->size, indexBuffer, &offset, indexEnd, sizeof(u64))
+                            && extent->offset <= entry->size && extent->size <= entry->size - extent->offset;
+                    }
+                    fileExtentCounts[fileEntryCount] = count;
+                    extentCount += count;
+                }
+            }
+            if(result && block == NO_BLOCK)
+            {
+                u64 storedSize = entryStoredSize(fileEntryCount);
+                result = fileOffsets[fileEntryCount] < dataEnd && storedSize < dataEnd - fileOffsets[fileEntryCount]; //NOTE(alg): + null-terminator
+            }
+            if(result)
+            {
+                ++fileEntryCount;
+            }
+        }
+        if(indexBuffer != headerBuffer)
+        {
+            free(indexBuffer);
+        }
+        if(!result && !volumeMissing)
+        {
+            printf("Error: corrupt header in %s\n", packFilePath);
+        }
+    }
+    else
+    {
+        printf("Error: Could not read header of %s\n", packFilePath);
+    }
+    free(headerBuffer);
+    return result;
+}
+
+static
+BlockCacheSlot* getCachedBlock(PackReader* reader, u32 blockIndex)
+{
+    ++reader->useCounter;
+    BlockCacheSlot* leastRecentlyUsed = reader->cache;
+    for(u32 i=0; i<BLOCK_CACHE_SLOT_COUNT; ++i)
+    {
+        BlockCacheSlot* slot = reader->cache + i;
+        if(slot->blockIndex == blockIndex)
+        {
+            slot->lastUse = reader->useCounter;
+            ++reader->cacheHitCount;
+            return slot;
+        }
+        if(slot->lastUse < leastRecentlyUsed->lastUse)
+        {
+            leastRecentlyUsed = slot;
+        }
+    }
+    
+    ++reader->cacheMissCount;
+    BlockCacheSlot* slot = leastRecentlyUsed;
+    slot->blockIndex = NO_BLOCK;
+    u64 size = blockSizes[blockIndex];
+    if(slot->capacity < size)
+    {
+        free(slot->data);
+        slot->data = malloc(size);
+        slot->capacity = slot->data ? size : 0;
+    }
+    if(slot->data && readPackRange(reader, blockOffsets[blockIndex], slot->data, size))
+    {
+        //NOTE(alg): decode the block here, e.g. decompress/de-obfuscate
+        slot->blockIndex = blockIndex;
+        slot->lastUse = reader->useCounter;
+        return slot;
+    }
+    return 0;
+}
+
+//NOTE(alg): reads a file that is part of a solid block. The returned data is null-terminated and valid 
+//until the block is evicted from the cache.
+static
+void* readPackedEntry(PackReader* reader, u32 entryIndex)
+{
+    void* result = 0;
+    u32 block = fileBlocks[entryIndex];
+    RP_ASSERT(block != NO_BLOCK);
+    BlockCacheSlot* slot = getCachedBlock(reader, block);
+    if(slot)
+    {
+        result = (char*)slot->data + fileOffsets[entryIndex];
+    }
+    return result;
+}
+
+//NOTE(alg): reads <size> bytes (at most PACK_READ_CHUNK_SIZE) of a file that is not part of a solid block, starting
+//<storedOffset> bytes into its stored data (for a file with extents, the contents of its extents back to back).
+//Large files are read chunk by chunk, so memory does not grow with the file size.
+//The returned data is valid until the next call.
+static
+void* readPackedChunk(PackReader* reader, u32 entryIndex, u64 storedOffset, u64 size)
+{
+    RP_ASSERT(fileBlocks[entryIndex] == NO_BLOCK && size <= PACK_READ_CHUNK_SIZE);
+    if(!reader->scratch)
+    {
+        reader->scratch = malloc(PACK_READ_CHUNK_SIZE);
+    }
+    if(reader->scratch && readPackRange(reader, fileOffsets[entryIndex] + storedOffset, reader->scratch, size))
+    {
+        //NOTE(alg): do sth with file contents here, e.g. de-obfuscate
+        return reader->scratch;
+    }
+    return 0;
+}
+
+static
+void closePackFile(PackReader* reader)
+{
+    for(u32 i=0; i<BLOCK_CACHE_SLOT_COUNT; ++i)
+    {
+        free(reader->cache[i].data);
+        reader->cache[i].data = 0;
+        reader->cache[i].capacity = 0;
+        reader->cache[i].blockIndex = NO_BLOCK;
+    }
+    free(reader->scratch);
+    reader->scratch = 0;
+    for(u32 i=0; i<MAX_VOLUME_COUNT; ++i)
+    {
+        if(reader->volumes[i] && reader->volumes[i] != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(reader->volumes[i]);
+        }
+        reader->volumes[i] = 0;
+    }
+}
+
+static
+bool extractEntryToDisk(PackReader* reader, u32 entryIndex, char const * targetDir)
+{
+    bool result = true;
+    FileEntry* entry = fileEntries + entryIndex;
+    printf("%s %llu bytes\n", entryName(entry), entry->size);
+    
+    void* blockContents = 0;
+    if(fileBlocks[entryIndex] != NO_BLOCK)
+    {
+        blockContents = readPackedEntry(reader, entryIndex);
+        if(!blockContents)
+        {
+            printf("Error: could not read %s from %s\n", entry->path, reader->packFilePath);
+            return false;
+        }
+    }
+    
+    char buffer[MAX_PATH] = {};
+    stringCopy(buffer, targetDir, MAX_PATH, MAX_PATH);
+    stringCat(buffer, "/", MAX_PATH);
+    stringCat(buffer, entry->path, MAX_PATH);
+    
+    createDirectoriesRecursively(buffer);
+    
+    HANDLE outputFile = CreateFile(buffer, 
+                                   GENERIC_WRITE, 
+                                   FILE_SHARE_READ, 
+                                   NULL, 
+                                   CREATE_ALWAYS, 
+                                   FILE_ATTRIBUTE_NORMAL, 
+                                   NULL);
+    if(outputFile != INVALID_HANDLE_VALUE)
+    {
+        bool readSuccess = true;
+        bool writeSuccess = true;
+        if(blockContents)
+        {
+            writeSuccess = writeFileRange(outputFile, 0, blockContents, entry->size);
+        }
+        else
+        {
+            //NOTE(alg): a dense file is a single extent covering the whole file
+            FileExtent denseExtent = {0, entry->size};
+            FileExtent* extents = &denseExtent;
+            u32 count = 1;
+            if(fileExtentCounts[entryIndex] != NO_EXTENTS)
+            {
+                //NOTE(alg): only the extents are written, extending the sparse file to its full size
+                //leaves the holes unallocated. If the file system does not support sparse files,
+                //it fills them with zeros itself.
+                DWORD returnedByteCount = 0;
+                DeviceIoControl(outputFile, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &returnedByteCount, NULL);
+                extents = fileExtents + fileFirstExtents[entryIndex];
+                count = fileExtentCounts[entryIndex];
+            }
+            
+            u64 storedOffset = 0;
+            for(u32 e=0; e<count && readSuccess && writeSuccess; ++e)
+            {
+                for(u64 at=0; at<extents[e].size && readSuccess && writeSuccess;)
+                {
+                    u64 chunkSize = extents[e].size - at < PACK_READ_CHUNK_SIZE ? extents[e].size - at : PACK_READ_CHUNK_SIZE;
+                    void* chunk = readPackedChunk(reader, entryIndex, storedOffset, chunkSize);
+                    readSuccess = chunk != 0;
+                    writeSuccess = !readSuccess || writeFileRange(outputFile, extents[e].offset + at, chunk, chunkSize);
+                    storedOffset += chunkSize;
+                    at += chunkSize;
+                }
+            }
+            if(fileExtentCounts[entryIndex] != NO_EXTENTS)
+            {
+                LARGE_INTEGER fileSize;
+                fileSize.QuadPart = entry->size;
+                writeSuccess = writeSuccess 
+                    && SetFilePointerEx(outputFile, fileSize, NULL, FILE_BEGIN) == TRUE
+                    && SetEndOfFile(outputFile) == TRUE;
+            }
+        }
+        if(!readSuccess)
+        {
+            printf("Error: could not read %s from %s\n", entry->path, reader->packFilePath);
+            result = false;
+        }
+        else if(!writeSuccess)
+        {
+            printf("Error: could not write file %s\n", buffer);
+            result = false;
+        }
+        CloseHandle(outputFile);
+    }
+    else
+    {
+        printf("Error creating file %s\n", entryName(entry));
+        result = false;
+    }
+    return result;
+}
+
+bool fileSelected[MAX_FILE_ENTRY_COUNT];
+u64 blockCacheHitCount; //NOTE(alg): statistics of the last extraction
+u64 blockCacheMissCount;
+u32 volumeFirstEntries[MAX_VOLUME_COUNT + 1];
+u32 volumeEntries[MAX_FILE_ENTRY_COUNT]; //NOTE(alg): selected entries, ordered by the volume their data starts in
+
+//NOTE(alg): a solid block is always read as a whole, so its files belong to the volume the block starts in
+inline
+u32 entryVolume(u32 entryIndex)
+{
+    u32 block = fileBlocks[entryIndex];
+    return volumeOfOffset(block != NO_BLOCK ? blockOffsets[block] : fileOffsets[entryIndex]);
+}
+
+struct VolumeExtractJob
+{
+    char const * packFilePath;
+    char const * targetDir;
+    PackReader* readers;
+    volatile LONG nextReader;
+    volatile LONG nextVolume;
+    volatile LONG failed;
+};
+
+static
+DWORD WINAPI extractVolumesThread(LPVOID param)
+{
+    VolumeExtractJob* job = (VolumeExtractJob*)param;
+    PackReader* reader = job->readers + InterlockedIncrement(&job->nextReader) - 1;
+    attachPackReader(reader, job->packFilePath);
+    for(;;)
+    {
+        u32 volume = (u32)InterlockedIncrement(&job->nextVolume) - 1;
+        if(volume >= volumeCount)
+        {
+            break;
+        }
+        for(u32 i=volumeFirstEntries[volume]; i<volumeFirstEntries[volume + 1]; ++i)
+        {
+            if(!extractEntryToDisk(reader, volumeEntries[i], job->targetDir))
+            {
+                InterlockedExchange(&job->failed, 1);
+            }
+        }
+    }
+    return 0;
+}
+
+//NOTE(alg): extracts the files whose path starts with one of <pathFilters>, or all files if there are none.
+//Volumes are extracted in parallel, volumes without any requested file (or part of the index) are never opened.
+bool readFileAndExtractToDisk(char const * packFilePath, char const * targetDir, 
+                              char const * const * pathFilters, u32 pathFilterCount)
+{   
+    bool result = false;
+    PackReader reader = {};
+    if(openPackFile(&reader, packFilePath))
+    {
+        memset(volumeFirstEntries, 0, sizeof(volumeFirstEntries));
+        for(u32 i=0; i<fileEntryCount; ++i)
+        {
+            fileSelected[i] = pathFilterCount == 0;
+            for(u32 f=0; f<pathFilterCount && !fileSelected[i]; ++f)
+            {
+                fileSelected[i] = stringStartsWith(fileEntries[i].path, pathFilters[f]);
+            }
+            if(fileSelected[i])
+            {
+                RP_ASSERT(entryVolume(i) < volumeCount); //NOTE(alg): checked by openPackFile
+                ++volumeFirstEntries[entryVolume(i) + 1];
+            }
+        }
+        for(u32 v=0; v<volumeCount; ++v)
+        {
+            volumeFirstEntries[v + 1] += volumeFirstEntries[v];
+        }
+        u32 volumeCursors[MAX_VOLUME_COUNT];
+        memcpy(volumeCursors, volumeFirstEntries, volumeCount * sizeof(u32));
+        for(u32 i=0; i<fileEntryCount; ++i)
+        {
+            if(fileSelected[i])
+            {
+                volumeEntries[volumeCursors[entryVolume(i)]++] = i;
+            }
+        }
+        
+        VolumeExtractJob job = {};
+        job.packFilePath = packFilePath;
+        job.targetDir = targetDir;
+        u32 threadCount = volumeCount < VOLUME_THREAD_COUNT ? volumeCount : VOLUME_THREAD_COUNT;
+        job.readers = (PackReader*)calloc(threadCount, sizeof(PackReader));
+        if(job.readers)
+        {
+            HANDLE threads[VOLUME_THREAD_COUNT] = {};
+            u32 startedThreadCount = 0;
+            for(u32 i=1; i<threadCount; ++i)
+            {
+                HANDLE thread = CreateThread(NULL, 0, extractVolumesThread, &job, 0, NULL);
+                if(thread)
+                {
+                    threads[startedThreadCount++] = thread;
+                }
+            }
+            extractVolumesThread(&job);
+            if(startedThreadCount > 0)
+            {
+                WaitForMultipleObjects(startedThreadCount, threads, TRUE, INFINITE);
+            }
+            
+            blockCacheHitCount = 0;
+            blockCacheMissCount = 0;
+            for(u32 i=0; i<startedThreadCount; ++i)
+            {
+                CloseHandle(threads[i]);
+            }
+            for(u32 i=0; i<threadCount; ++i)
+            {
+                blockCacheHitCount += job.readers[i].cacheHitCount;
+                blockCacheMissCount += job.readers[i].cacheMissCount;
+                closePackFile(job.readers + i);
+            }
+            free(job.readers);
+            result = !job.failed;
+        }
+    }
+    closePackFile(&reader);
+    return result;
+}
+
+#if defined PACKER
+
+int main(int argc, const char* argv[])
+{
+    fileEntryCount = 0;
+    
+    if(argc < 3)
+    {
+        printf("Usage: filepacker <path-to-source-directory> <path-to-target-file> [-blocksize <bytes>]\n");
+        printf("                  [-volumesize <bytes> [-volumedir <path-to-directory>]...]\n");
+        printf("Example: filepacker C:/myDir C:/packedMyDir.bin -blocksize 65536\n");
+        printf("Example: filepacker C:/myDir C:/packedMyDir.bin -volumesize 1073741824 -volumedir D:/vol -volumedir E:/vol\n");
+        printf("A block size of 0 disables grouping small files into solid blocks (default: %u).\n", SOLID_BLOCK_DEFAULT_SIZE);
+        printf("A volume size > 0 splits the packed file into volumes, spread over the volume directories.\n");
+        return -1;
+    }
+    //NOTE(alg): may not contain trailing backslash!!
+    char const* sourceDirPath = argv[1];
+    
+    u32 blockSize = SOLID_BLOCK_DEFAULT_SIZE;
+    u64 maxVolumeSize = 0;
+    volumeDirCount = 0;
+    for(int i=3; i<argc; ++i)
+    {
+        if(stringEqual(argv[i], "-blocksize") && i + 1 < argc)
+        {
+            blockSize = (u32)strtoul(argv[++i], NULL, 10);
+        }
+        else if(stringEqual(argv[i], "-volumesize") && i + 1 < argc)
+        {
+            maxVolumeSize = strtoull(argv[++i], NULL, 10);
+        }
+        else if(stringEqual(argv[i], "-volumedir") && i + 1 < argc)
+        {
+            //NOTE(alg): leave room for the volume file name
+            char const * dir = argv[++i];
+            if(volumeDirCount >= MAX_VOLUME_DIR_COUNT || stringLength(dir) + stringLength(argv[2]) + 16 >= MAX_PATH)
+            {
+                printf("Error: too many or too long volume directories\n");
+                return -1;
+            }
+            stringCopy(volumeDirs[volumeDirCount++], dir, MAX_PATH, MAX_PATH);
+        }
+        else
+        {
+            printf("Unknown argument %s\n", argv[i]);
+            return -1;
+        }
+    }
+    
+    if(!findFilesRecursively(sourceDirPath, "", fileEntries, &fileEntryCount))
+    {
+        //NOTE(alg): never ship an archive that silently lacks files
+        printf("Error: could not list all files under %s, nothing packed\n", sourceDirPath);
+        return -1;
+    }
+    
+    char const* targetFilePath = argv[2];
+    bool result = packIntoBufferAndWriteFile(sourceDirPath, targetFilePath, blockSize, maxVolumeSize);
+    return result ? 0 : -1;
+}
+
+#elif defined UNPACKER
+
+int main(int argc, const char* argv[])
+{
+    fileEntryCount = 0;
+    
+    if(argc < 3)
+    {
+        printf("Usage: fileunpacker <path-to-packed-file> <path-to-target-directory> [<path-prefix>...]\n");
+        printf("Example: fileunpacker C:/packedMyDir.bin C:/unpackedMyDir\n");
+        printf("Example: fileunpacker C:/packedMyDir.bin C:/unpackedMyDir docs/ include/\n");
+        printf("Only files whose path starts with one of the given prefixes are extracted, all files if none are given.\n");
+        return -1;
+    }
+    char const* packfilename = argv[1];
+    //NOTE(alg): must point to an existing directory!
+    //NOTE(alg): may not contain trailing backslash!!
+    char const * extractTargetDir = argv[2];
+    bool result = readFileAndExtractToDisk(packfilename, extractTargetDir, argv + 3, argc - 3);
+    return result ? 0 : -1;
+}
+
+#elif defined FILEPACKERTEST
+
+FileEntry filesA[MAX_FILE_ENTRY_COUNT];
+FileEntry filesB[MAX_FILE_ENTRY_COUNT];
+u32 sortedFilesB[MAX_FILE_ENTRY_COUNT];
+u32 fileCountA;
+u32 fileCountB;
+
+u32 const MAX_BENCHMARK_RUN_COUNT = 32;
+
+static
+double getSeconds()
+{
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+//NOTE(alg): deletes all files and directories beneath <dir>, but not <dir> itself
+static
+void deleteDirectoryContents(char const * dir)
+{
+    char pattern[MAX_PATH] = {};
+    stringCopy(pattern, dir, MAX_PATH, MAX_PATH);
+    stringCat(pattern, "\\*", MAX_PATH);
+    WIN32_FIND_DATA findData;
+    HANDLE findHandle = FindFirstFileA(pattern, &findData);
+    if(findHandle != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if(!stringEqual(findData.cFileName, ".") && !stringEqual(findData.cFileName, ".."))
+            {
+                char path[MAX_PATH] = {};
+                stringCopy(path, dir, MAX_PATH, MAX_PATH);
+                stringCat(path, "/", MAX_PATH);
+                stringCat(path, findData.cFileName, MAX_PATH);
+                if(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                {
+                    deleteDirectoryContents(path);
+                    RemoveDirectory(path);
+                }
+                else
+                {
+                    DeleteFile(path);
+                }
+            }
+        } while(FindNextFile(findHandle, &findData) != 0);
+        FindClose(findHandle);
+    }
+}
+
+static
+int compareSeconds(void const * A, void const * B)
+{
+    double a = *(double const *)A;
+    double b = *(double const *)B;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static
+int compareFilePathsB(void const * A, void const * B)
+{
+    return strcmp(filesB[*(u32 const *)A].path, filesB[*(u32 const *)B].path);
+}
+
+//NOTE(alg): binary search in <sortedFilesB>, so comparing large trees stays O(n log n)
+u32 findFileInB(char const * relPath)
+{
+    u32 low = 0;
+    u32 high = fileCountB;
+    while(low < high)
+    {
+        u32 mid = low + (high - low) / 2;
+        int order = strcmp(filesB[sortedFilesB[mid]].path, relPath);
+        if(order == 0)
+        {
+            return sortedFilesB[mid];
+        }
+        if(order < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return -1;
+}
+
+//NOTE(alg): B must contain exactly the files of A whose path starts with <pathPrefix>
+static
+bool compareDirectoryTreeContents(char const * A, char const * B, char const * pathPrefix)
+{
+    bool result = true;
+    fileCountA = 0;
+    fileCountB = 0;
+    result = findFilesRecursively(A, "", filesA, &fileCountA) && result;
+    result = findFilesRecursively(B, "", filesB, &fileCountB) && result;
+    u32 keptCountA = 0;
+    for(u32 i=0; i<fileCountA; ++i)
+    {
+        if(stringStartsWith(filesA[i].path, pathPrefix))
+        {
+            filesA[keptCountA++] = filesA[i];
+        }
+    }
+    fileCountA = keptCountA;
+    for(u32 i=0; i<fileCountB; ++i)
+    {
+        sortedFilesB[i] = i;
+    }
+    qsort(sortedFilesB, fileCountB, sizeof(u32), compareFilePathsB);
+    if(fileCountA == fileCountB)
+    {
+        for(u32 i=0; i<fileCountA; ++i)
         {
             FileEntry* a = filesA + i;
             
@@ -622,7 +2064,7 @@ bool compareDirectoryTreeContents(char const * A, char const * B)
                                            NULL);
             if(inputFileA != INVALID_HANDLE_VALUE)
             {
-                u32 foundIdx = findFileIn(a->path, filesB, fileCountB);
+                u32 foundIdx = findFileInB(a->path);
                 if(foundIdx != -1)
                 {
                     FileEntry* b = filesB + foundIdx;
@@ -640,26 +2082,33 @@ bool compareDirectoryTreeContents(char const * A, char const * B)
                                                    NULL);
                     if(inputFileB != INVALID_HANDLE_VALUE)
                     {
-                        void* inputFileBufferA = malloc(a->size);
-                        void* inputFileBufferB = malloc(b->size);
-                        {
-                            DWORD readByteCount = 0;
-                            BOOL success = ReadFile(inputFileA, inputFileBufferA, a->size, &readByteCount, NULL);
-                            RP_ASSERT(readByteCount == a->size);
-                        }
+                        //NOTE(alg): compared chunk by chunk, so files larger than 4 GB or than memory work as well
+                        void* inputFileBufferA = malloc(PACK_READ_CHUNK_SIZE);
+                        void* inputFileBufferB = malloc(PACK_READ_CHUNK_SIZE);
+                        bool equal = a->size == b->size && inputFileBufferA && inputFileBufferB;
+                        for(u64 at=0; at<a->size && equal; at+=PACK_READ_CHUNK_SIZE)
                         {
-                            DWORD readByteCount = 0;
-                            BOOL success = ReadFile(inputFileB, inputFileBufferB, b->size, &readByteCount, NULL);
-                            RP_ASSERT(readByteCount == b->size);
+                            u64 chunkSize = a->size - at < PACK_READ_CHUNK_SIZE ? a->size - at : PACK_READ_CHUNK_SIZE;
+                            equal = readFileRange(inputFileA, at, inputFileBufferA, chunkSize)
+                                && readFileRange(inputFileB, at, inputFileBufferB, chunkSize)
+                                && memcmp(inputFileBufferA, inputFileBufferB, chunkSize) == 0;
                         }
-                        bool equal = stringEqual((char*)inputFileBufferA, (char*)inputFileBufferB);
                         if(!equal)
                         {
                             printf("ERROR: files %s and %s are different\n", a->path, b->path);
                         }
                         result &= equal;
+                        free(inputFileBufferA);
+                        free(inputFileBufferB);
+                        CloseHandle(inputFileB);
                     }
                 }
+                else
+                {
+                    printf("ERROR: file %s is missing\n", a->path);
+                    result = false;
+                }
+                CloseHandle(inputFileA);
             }
         }
     }
@@ -671,22 +2120,198 @@ bool compareDirectoryTreeContents(char const * A, char const * B)
     return result;
 }
 
+//NOTE(alg): reads every file of the packed file through the reader without writing it anywhere,
+//to measure the reader itself
+static
+double readAllPackedEntries(char const * packFilePath)
+{
+    double start = getSeconds();
+    fileEntryCount = 0;
+    PackReader reader = {};
+    if(openPackFile(&reader, packFilePath))
+    {
+        for(u32 i=0; i<fileEntryCount; ++i)
+        {
+            bool success = true;
+            if(fileBlocks[i] != NO_BLOCK)
+            {
+                success = readPackedEntry(&reader, i) != 0;
+            }
+            else
+            {
+                u64 storedSize = entryStoredSize(i);
+                for(u64 at=0; at<storedSize && success; at+=PACK_READ_CHUNK_SIZE)
+                {
+                    u64 chunkSize = storedSize - at < PACK_READ_CHUNK_SIZE ? storedSize - at : PACK_READ_CHUNK_SIZE;
+                    success = readPackedChunk(&reader, i, at, chunkSize) != 0;
+                }
+            }
+            if(!success)
+            {
+                printf("ERROR: could not read %s\n", fileEntries[i].path);
+            }
+        }
+    }
+    closePackFile(&reader);
+    return getSeconds() - start;
+}
+
+//NOTE(alg): writes <dataSize> bytes of <fill> at the start and at the end of a file of <fileSize> bytes.
+//With <sparse>, the range in between is a hole, otherwise it is written with zeros.
+static
+bool writeFixtureFile(char const * path, u64 fileSize, u64 dataSize, u8 fill, bool sparse)
+{
+    HANDLE file = CreateFile(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        printf("ERROR: could not create %s\n", path);
+        return false;
+    }
+    bool result = true;
+    u8* buffer = (u8*)calloc(PACK_READ_CHUNK_SIZE, 1);
+    if(sparse)
+    {
+        DWORD returnedByteCount = 0;
+        result = DeviceIoControl(file, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &returnedByteCount, NULL) == TRUE;
+    }
+    for(u64 at=0; at<fileSize && result && buffer; at+=PACK_READ_CHUNK_SIZE)
+    {
+        u64 chunkSize = fileSize - at < PACK_READ_CHUNK_SIZE ? fileSize - at : PACK_READ_CHUNK_SIZE;
+        if(!sparse)
+        {
+            result = writeFileRange(file, at, buffer, chunkSize);
+        }
+    }
+    if(buffer && dataSize > 0)
+    {
+        memset(buffer, fill, dataSize);
+        result = result
+            && writeFileRange(file, 0, buffer, dataSize)
+            && writeFileRange(file, fileSize - dataSize, buffer, dataSize);
+    }
+    LARGE_INTEGER size;
+    size.QuadPart = fileSize;
+    result = result && buffer 
+        && SetFilePointerEx(file, size, NULL, FILE_BEGIN) == TRUE 
+        && SetEndOfFile(file) == TRUE;
+    free(buffer);
+    CloseHandle(file);
+    return result;
+}
+
+//NOTE(alg): round trip of a fixture that does not depend on the source tree: a sparse file with a little data
+//at both ends, and a file that is allocated but all zeros. Holes must neither be stored in the packed file
+//nor be allocated in the extracted files.
+static
+bool testSparseRoundTrip(char const * extractTargetDir, u32 blockSize)
+{
+    u64 const sparseFileSize = 8*1024*1024;
+    u64 const zeroFileSize = 2*1024*1024;
+    char const * fixtureNames[2] = { "sparse.img", "zeros.bin" };
+    u64 const fixtureSizes[2] = { sparseFileSize, zeroFileSize };
+    
+    char sourceDir[MAX_PATH] = {};
+    stringCopy(sourceDir, extractTargetDir, MAX_PATH, MAX_PATH);
+    stringCat(sourceDir, "_sparse_source", MAX_PATH);
+    char targetDir[MAX_PATH] = {};
+    stringCopy(targetDir, extractTargetDir, MAX_PATH, MAX_PATH);
+    stringCat(targetDir, "_sparse", MAX_PATH);
+    CreateDirectory(sourceDir, NULL);
+    CreateDirectory(targetDir, NULL);
+    deleteDirectoryContents(targetDir);
+    
+    bool result = true;
+    for(u32 i=0; i<2 && result; ++i)
+    {
+        char path[MAX_PATH] = {};
+        stringCopy(path, sourceDir, MAX_PATH, MAX_PATH);
+        stringCat(path, "/", MAX_PATH);
+        stringCat(path, fixtureNames[i], MAX_PATH);
+        result = writeFixtureFile(path, fixtureSizes[i], i == 0 ? 4096 : 0, 0xAB, i == 0);
+    }
+    
+    char const * packFilePath = "packed_sparse.bin";
+    fileEntryCount = 0;
+    volumeDirCount = 0;
+    result = result 
+        && findFilesRecursively(sourceDir, "", fileEntries, &fileEntryCount)
+        && packIntoBufferAndWriteFile(sourceDir, packFilePath, blockSize, 0);
+    
+    u64 packedSize = 0;
+    HANDLE packFile = result ? CreateFile(packFilePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL) : INVALID_HANDLE_VALUE;
+    if(packFile != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER size = {};
+        GetFileSizeEx(packFile, &size);
+        packedSize = size.QuadPart;
+        CloseHandle(packFile);
+    }
+    if(result && (packedSize == 0 || packedSize >= zeroFileSize))
+    {
+        printf("ERROR: packed file of %llu bytes, holes were stored\n", packedSize);
+        result = false;
+    }
+    
+    fileEntryCount = 0;
+    result = result 
+        && readFileAndExtractToDisk(packFilePath, targetDir, NULL, 0)
+        && compareDirectoryTreeContents(sourceDir, targetDir, "");
+    for(u32 i=0; i<2 && result; ++i)
+    {
+        char path[MAX_PATH] = {};
+        stringCopy(path, targetDir, MAX_PATH, MAX_PATH);
+        stringCat(path, "/", MAX_PATH);
+        stringCat(path, fixtureNames[i], MAX_PATH);
+        DWORD high = 0;
+        DWORD low = GetCompressedFileSize(path, &high);
+        u64 allocatedSize = ((u64)high << 32) | low;
+        if(low == INVALID_FILE_SIZE || allocatedSize >= fixtureSizes[i])
+        {
+            printf("ERROR: %s has %llu of %llu bytes allocated, holes were not restored\n", path, allocatedSize, fixtureSizes[i]);
+            result = false;
+        }
+    }
+    printf("Sparse fixture packed to %llu bytes, extracted with holes: %s\n", packedSize, result ? "OK" : "FAIL");
+    return result;
+}
+
 int main(int argc, const char* argv[])
 {
     fileEntryCount = 0;
     
     if(argc < 3)
     {
-        printf("Usage: filepackertest <path-to-source-directory> <path-to-target-directory>\n");
+        printf("Usage: filepackertest <path-to-source-directory> <path-to-target-directory> [-blocksize <bytes>] [-runs <count>]\n");
         printf("Example: filepackertest C:/myDir C:/myTestDir\n");
+        printf("Extraction and the read-all pass are repeated <count> times, the minimum and median times are reported.\n");
         return -1;
     }
+    u32 blockSize = SOLID_BLOCK_DEFAULT_SIZE;
+    u32 runCount = 1;
+    for(int i=3; i+1<argc; i+=2)
+    {
+        if(stringEqual(argv[i], "-blocksize"))
+        {
+            blockSize = (u32)strtoul(argv[i + 1], NULL, 10);
+        }
+        else if(stringEqual(argv[i], "-runs"))
+        {
+            runCount = (u32)strtoul(argv[i + 1], NULL, 10);
+            runCount = runCount < 1 ? 1 : (runCount > MAX_BENCHMARK_RUN_COUNT ? MAX_BENCHMARK_RUN_COUNT : runCount);
+        }
+    }
     
     //NOTE(alg): may not contain trailing backslash!!
     char const* dir = argv[1];
-    findFilesRecursively(dir, "", fileEntries, &fileEntryCount);
+    double packStart = getSeconds();
+    if(!findFilesRecursively(dir, "", fileEntries, &fileEntryCount))
+    {
+        printf("Error: could not list all files under %s\n", dir);
+        return -1;
+    }
     char const * packFileName = "packed.bin";
-    packIntoBufferAndWriteFile(dir, packFileName);
+    packIntoBufferAndWriteFile(dir, packFileName, blockSize, 0);
+    double packSeconds = getSeconds() - packStart;
     
     char const * packFilePath = "packed.bin";
     
@@ -695,11 +2320,95 @@ int main(int argc, const char* argv[])
     //NOTE(alg): may not contain trailing backslash!!
     char const * extractTargetDir = argv[2];
     
-    //TODO(alg): delete directories/files beneath extractTargetDir to rule out results from previous runs
+    //NOTE(alg): single runs vary a lot with file system state, so compare configurations by minimum and median.
+    //Every run extracts into an emptied directory, also to rule out results from previous runs.
+    double unpackSeconds[MAX_BENCHMARK_RUN_COUNT];
+    double readSeconds[MAX_BENCHMARK_RUN_COUNT];
+    for(u32 r=0; r<runCount; ++r)
+    {
+        deleteDirectoryContents(extractTargetDir);
+        fileEntryCount = 0;
+        double unpackStart = getSeconds();
+        readFileAndExtractToDisk(packFilePath, extractTargetDir, NULL, 0);
+        unpackSeconds[r] = getSeconds() - unpackStart;
+        readSeconds[r] = readAllPackedEntries(packFilePath);
+        printf("Run %u: unpacked in %.3fs, read all files without extracting in %.3fs\n", r + 1, unpackSeconds[r], readSeconds[r]);
+    }
+    qsort(unpackSeconds, runCount, sizeof(double), compareSeconds);
+    qsort(readSeconds, runCount, sizeof(double), compareSeconds);
+    printf("%u files in %u solid blocks: packed in %.3fs\n", fileEntryCount, blockCount, packSeconds);
+    printf("Unpacked in %.3fs min, %.3fs median over %u runs\n", unpackSeconds[0], unpackSeconds[runCount / 2], runCount);
+    printf("Read all files without extracting in %.3fs min, %.3fs median\n", readSeconds[0], readSeconds[runCount / 2]);
+    printf("Block cache (last run): %llu hits, %llu misses\n", blockCacheHitCount, blockCacheMissCount);
+    
+    double compareStart = getSeconds();
+    bool ok = compareDirectoryTreeContents(dir, extractTargetDir, "");
+    printf("Compared in %.3fs\n", getSeconds() - compareStart);
+    
+    //NOTE(alg): second round trip with small volumes spread over two volume directories, so that blocks
+    //and files cross volume boundaries. The volume size grows for large trees to stay below MAX_VOLUME_COUNT.
+    u64 packedSizeBound = 4096;
+    for(u32 i=0; i<fileEntryCount; ++i)
+    {
+        packedSizeBound += fileEntries[i].size + fileEntries[i].size / 1024 + 2 * fileEntries[i].pathLen + 64;
+    }
+    u64 testVolumeSize = 64*1024;
+    while(testVolumeSize * MAX_VOLUME_COUNT < packedSizeBound)
+    {
+        testVolumeSize *= 2;
+    }
+    fileEntryCount = 0;
+    findFilesRecursively(dir, "", fileEntries, &fileEntryCount);
+    volumeDirCount = 2;
+    stringCopy(volumeDirs[0], "packed_volumes_a", MAX_PATH, MAX_PATH);
+    stringCopy(volumeDirs[1], "packed_volumes_b", MAX_PATH, MAX_PATH);
+    char const * volumePackFilePath = "packed_volumes.bin";
+    bool volumeOk = packIntoBufferAndWriteFile(dir, volumePackFilePath, blockSize, testVolumeSize);
+    u32 packedVolumeCount = volumeCount;
+    
+    //NOTE(alg): files are only compared with A if they were extracted from B, pick a prefix that selects
+    //some but usually not all files: the top-level directory (or name) of the first file
+    char pathPrefix[MAX_PATH] = {};
+    if(fileEntryCount > 0)
+    {
+        FileEntry* first = fileEntries;
+        u32 at = stringFindSubstring(first->path, "/");
+        stringCopy(pathPrefix, first->path, MAX_PATH, at != -1 ? at : MAX_PATH);
+    }
+    
+    char volumeTargetDir[MAX_PATH] = {};
+    stringCopy(volumeTargetDir, extractTargetDir, MAX_PATH, MAX_PATH);
+    stringCat(volumeTargetDir, "_volumes", MAX_PATH);
+    CreateDirectory(volumeTargetDir, NULL);
+    deleteDirectoryContents(volumeTargetDir);
+    fileEntryCount = 0;
+    volumeOk = volumeOk && readFileAndExtractToDisk(volumePackFilePath, volumeTargetDir, NULL, 0);
+    volumeOk = volumeOk && compareDirectoryTreeContents(dir, volumeTargetDir, "");
+    
+    //NOTE(alg): the volumes are looked up next to the packed file if they are not in their volume directory
+    for(u32 i=1; i<packedVolumeCount && volumeOk; ++i)
+    {
+        char volumePath[MAX_PATH] = {};
+        char movedVolumePath[MAX_PATH] = {};
+        getVolumePath(volumePath, volumePackFilePath, i, true);
+        getVolumePath(movedVolumePath, volumePackFilePath, i, false);
+        volumeOk = MoveFileEx(volumePath, movedVolumePath, MOVEFILE_REPLACE_EXISTING) == TRUE;
+    }
+    char filteredTargetDir[MAX_PATH] = {};
+    stringCopy(filteredTargetDir, extractTargetDir, MAX_PATH, MAX_PATH);
+    stringCat(filteredTargetDir, "_filtered", MAX_PATH);
+    CreateDirectory(filteredTargetDir, NULL);
+    deleteDirectoryContents(filteredTargetDir);
+    char const * pathFilters[1] = { pathPrefix };
+    fileEntryCount = 0;
+    volumeOk = volumeOk && readFileAndExtractToDisk(volumePackFilePath, filteredTargetDir, pathFilters, 1);
+    volumeOk = volumeOk && compareDirectoryTreeContents(dir, filteredTargetDir, pathPrefix);
+    printf("%u volumes of %llu bytes, extracted all and '%s' after moving the volumes: %s\n", 
+           packedVolumeCount, testVolumeSize, pathPrefix, volumeOk ? "OK" : "FAIL");
+    ok &= volumeOk;
     
-    readFileAndExtractToDisk(packFilePath, extractTargetDir);
+    ok &= testSparseRoundTrip(extractTargetDir, blockSize);
     
-    bool ok = compareDirectoryTreeContents(dir, extractTargetDir);
     RP_ASSERT(ok);
     printf("Result : %s\n", ok ? "OK" : "FAIL");
     return 0;